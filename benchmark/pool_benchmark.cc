@@ -0,0 +1,640 @@
+#include <benchmark/benchmark.h>
+#include "ZPmemoryPool.h"
+#include "PoolAllocator.h"
+#include "ObjectPool.h"
+#include "Arena.h"
+#include "HeapProfiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#if defined(ZP_BENCH_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#endif
+#if defined(ZP_BENCH_MIMALLOC)
+#include <mimalloc.h>
+#endif
+
+using namespace ZPmemoryPool;
+
+// Allocators under test. Each one exposes the same sized alloc/free pair so
+// every benchmark below can be instantiated for all of them.
+struct HashBucketAllocator {
+    static void* allocate(size_t size) { return HashBucket::useMemory(size); }
+    static void deallocate(void* ptr, size_t size) { HashBucket::freeMemory(ptr, size); }
+};
+
+struct NewDeleteAllocator {
+    static void* allocate(size_t size) { return operator new(size); }
+    static void deallocate(void* ptr, size_t size) { operator delete(ptr, size); }
+};
+
+struct MallocAllocator {
+    static void* allocate(size_t size) { return std::malloc(size); }
+    static void deallocate(void* ptr, size_t) { std::free(ptr); }
+};
+
+#if defined(ZP_BENCH_JEMALLOC)
+struct JemallocAllocator {
+    static void* allocate(size_t size) { return mallocx(size, 0); }
+    static void deallocate(void* ptr, size_t size) { sdallocx(ptr, size, 0); }
+};
+#endif
+
+#if defined(ZP_BENCH_MIMALLOC)
+struct MimallocAllocator {
+    static void* allocate(size_t size) { return mi_malloc(size); }
+    static void deallocate(void* ptr, size_t size) { mi_free_size(ptr, size); }
+};
+#endif
+
+// Allocate and immediately free one block of state.range(0) bytes.
+template<typename Alloc>
+static void BM_AllocFree(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    for(auto _ : state) {
+        void* ptr = Alloc::allocate(size);
+        benchmark::DoNotOptimize(ptr);
+        Alloc::deallocate(ptr, size);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Allocate a burst of 512 blocks, then free them all: exercises refills and
+// flushes of the thread cache rather than the single-slot fast path.
+template<typename Alloc>
+static void BM_BurstAllocFree(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    constexpr size_t kBurst = 512;
+    std::vector<void*> ptrs(kBurst);
+    for(auto _ : state) {
+        for(size_t i = 0; i < kBurst; ++i) {
+            ptrs[i] = Alloc::allocate(size);
+        }
+        benchmark::DoNotOptimize(ptrs.data());
+        for(size_t i = 0; i < kBurst; ++i) {
+            Alloc::deallocate(ptrs[i], size);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kBurst);
+}
+
+// Random-lifetime churn: a window of live blocks with sizes drawn from
+// [8, state.range(0)]; every iteration frees a random victim and replaces it.
+template<typename Alloc>
+static void BM_RandomChurn(benchmark::State& state) {
+    const size_t max_size = static_cast<size_t>(state.range(0));
+    constexpr size_t kLive = 4096;
+    std::mt19937_64 rng(42 + state.thread_index());
+    std::uniform_int_distribution<size_t> size_dist(8, max_size);
+    std::uniform_int_distribution<size_t> victim_dist(0, kLive - 1);
+
+    std::vector<std::pair<void*, size_t>> live(kLive);
+    for(auto& entry : live) {
+        entry.second = size_dist(rng);
+        entry.first = Alloc::allocate(entry.second);
+    }
+    // Pre-generate the random stream so the RNG stays out of the timing
+    std::vector<std::pair<size_t, size_t>> script(1 << 16);
+    for(auto& step : script) {
+        step = {victim_dist(rng), size_dist(rng)};
+    }
+
+    size_t i = 0;
+    for(auto _ : state) {
+        const auto& step = script[i++ & (script.size() - 1)];
+        auto& entry = live[step.first];
+        Alloc::deallocate(entry.first, entry.second);
+        entry.second = step.second;
+        entry.first = Alloc::allocate(entry.second);
+        benchmark::DoNotOptimize(entry.first);
+    }
+    for(auto& entry : live) {
+        Alloc::deallocate(entry.first, entry.second);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Producer/consumer: even threads allocate, the odd thread next to them frees
+// through a single-producer/single-consumer ring.
+namespace {
+
+struct alignas(64) Ring {
+    static constexpr size_t kCapacity = 1024;
+    std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) void* items[kCapacity];
+};
+
+std::unique_ptr<Ring[]> g_rings;
+
+} // namespace
+
+template<typename Alloc>
+static void BM_CrossThreadFree(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    if(state.thread_index() == 0) {
+        g_rings.reset(new Ring[(state.threads() + 1) / 2]);
+    }
+    const bool producer = state.thread_index() % 2 == 0;
+    const bool paired = state.thread_index() + 1 < state.threads() || !producer;
+    Ring* rings = nullptr;
+
+    for(auto _ : state) {
+        // Threads only meet at the start of the timing loop, so the rings set
+        // up by thread 0 can be picked up from the first iteration on.
+        if(rings == nullptr) {
+            rings = g_rings.get();
+        }
+        Ring& ring = rings[state.thread_index() / 2];
+        if(!paired) {
+            // Odd thread count: the last producer frees its own blocks
+            Alloc::deallocate(Alloc::allocate(size), size);
+        } else if(producer) {
+            void* ptr = Alloc::allocate(size);
+            size_t head = ring.head.load(std::memory_order_relaxed);
+            while(head - ring.tail.load(std::memory_order_acquire) == Ring::kCapacity) {
+                std::this_thread::yield();
+            }
+            ring.items[head % Ring::kCapacity] = ptr;
+            ring.head.store(head + 1, std::memory_order_release);
+        } else {
+            size_t tail = ring.tail.load(std::memory_order_relaxed);
+            while(ring.head.load(std::memory_order_acquire) == tail) {
+                std::this_thread::yield();
+            }
+            Alloc::deallocate(ring.items[tail % Ring::kCapacity], size);
+            ring.tail.store(tail + 1, std::memory_order_release);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// False sharing between neighbouring pools: every thread works on its own
+// MemoryPool, but the pools sit next to each other in one array, like the
+// HashBucket table. range(0) selects the free list policy (0: Locked,
+// 1: LockFree). Each pool keeps its free-list and bump state on separate
+// cache lines, so per-thread throughput should stay flat as threads are added;
+// BM_NeighbourPoolsPacked below is the same loop over the previous layout.
+namespace {
+
+std::unique_ptr<MemoryPool[]> g_neighbour_pools;
+
+} // namespace
+
+static void BM_NeighbourPools(benchmark::State& state) {
+    constexpr size_t kWindow = 16;
+    if(state.thread_index() == 0) {
+        const FreeListPolicy policy = state.range(0) == 1 ? FreeListPolicy::LockFree : FreeListPolicy::Locked;
+        g_neighbour_pools.reset(new MemoryPool[state.threads()]);
+        for(int i = 0; i < state.threads(); ++i) {
+            g_neighbour_pools[i].init(64, policy);
+        }
+    }
+    void* window[kWindow] = {};
+    MemoryPool* pool = nullptr;
+    size_t i = 0;
+
+    for(auto _ : state) {
+        if(pool == nullptr) {
+            pool = &g_neighbour_pools[state.thread_index()];
+        }
+        void*& slot = window[i++ % kWindow];
+        if(slot != nullptr) {
+            pool->Deallocate(slot);
+        }
+        slot = pool->Allocate();
+        benchmark::DoNotOptimize(slot);
+    }
+    for(void* slot : window) {
+        if(slot != nullptr) {
+            pool->Deallocate(slot);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_NeighbourPools)->Arg(0)->Arg(1)->ThreadRange(1, 64)->UseRealTime();
+
+// Baseline for BM_NeighbourPools: the MemoryPool fields in their previous
+// order and without alignas, so neighbouring pools in the array share cache
+// lines. Free list and bump cursor follow MemoryPool's Locked and LockFree
+// paths closely enough to show the layout cost, not the pool's features, so
+// compare how the two scale with threads rather than their single-thread times.
+namespace {
+
+struct PackedPool {
+    size_t block_size = 0;
+    size_t initial_block_size = 0;
+    size_t max_block_size = 0;
+    size_t slot_size = 64;
+    char* first_block = nullptr;
+    char* current_slot = nullptr;
+    std::atomic<void*> free_list{nullptr};
+    std::atomic<std::uint64_t> tagged_free_list{0};
+    FreeListPolicy policy = FreeListPolicy::Locked;
+    char* last_slot = nullptr;
+    std::mutex mutex_for_free_list;
+    std::mutex mutex_for_block;
+    std::atomic<size_t> bytes_reserved{0};
+    BlockProvider* provider = nullptr;
+
+    static constexpr int kTagShift = 48;
+    static constexpr std::uint64_t kPointerMask = (std::uint64_t(1) << kTagShift) - 1;
+
+    static void*& next(void* slot) { return *static_cast<void**>(slot); }
+
+    void* Allocate() {
+        if(policy == FreeListPolicy::LockFree) {
+            std::uint64_t head = tagged_free_list.load(std::memory_order_acquire);
+            while((head & kPointerMask) != 0) {
+                void* slot = reinterpret_cast<void*>(head & kPointerMask);
+                const std::uint64_t tag = (head >> kTagShift) + 1;
+                const std::uint64_t desired = reinterpret_cast<std::uint64_t>(next(slot)) | (tag << kTagShift);
+                if(tagged_free_list.compare_exchange_weak(head, desired, std::memory_order_acquire)) {
+                    return slot;
+                }
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_for_free_list);
+            if(void* slot = free_list.load(std::memory_order_relaxed)) {
+                free_list.store(next(slot), std::memory_order_relaxed);
+                return slot;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_for_block);
+        if(current_slot == last_slot) {
+            return nullptr;
+        }
+        void* slot = current_slot;
+        current_slot += slot_size;
+        return slot;
+    }
+
+    void Deallocate(void* slot) {
+        if(policy == FreeListPolicy::LockFree) {
+            std::uint64_t head = tagged_free_list.load(std::memory_order_relaxed);
+            std::uint64_t desired;
+            do {
+                next(slot) = reinterpret_cast<void*>(head & kPointerMask);
+                desired = reinterpret_cast<std::uint64_t>(slot) | (((head >> kTagShift) + 1) << kTagShift);
+            } while(!tagged_free_list.compare_exchange_weak(head, desired, std::memory_order_release,
+                                                          std::memory_order_relaxed));
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_for_free_list);
+            next(slot) = free_list.load(std::memory_order_relaxed);
+            free_list.store(slot, std::memory_order_relaxed);
+        }
+    }
+};
+
+std::unique_ptr<PackedPool[]> g_packed_pools;
+std::unique_ptr<char[]> g_packed_blocks;
+
+} // namespace
+
+static void BM_NeighbourPoolsPacked(benchmark::State& state) {
+    constexpr size_t kWindow = 16;
+    constexpr size_t kBlockSize = 4096;
+    static_assert(kWindow * 64 <= kBlockSize);
+    if(state.thread_index() == 0) {
+        const FreeListPolicy policy = state.range(0) == 1 ? FreeListPolicy::LockFree : FreeListPolicy::Locked;
+        g_packed_pools.reset(new PackedPool[state.threads()]);
+        g_packed_blocks.reset(new char[kBlockSize * state.threads()]);
+        for(int i = 0; i < state.threads(); ++i) {
+            PackedPool& p = g_packed_pools[i];
+            p.policy = policy;
+            p.block_size = p.initial_block_size = p.max_block_size = kBlockSize;
+            p.first_block = p.current_slot = g_packed_blocks.get() + kBlockSize * i;
+            p.last_slot = p.first_block + kBlockSize;
+            p.bytes_reserved.store(kBlockSize, std::memory_order_relaxed);
+        }
+    }
+    void* window[kWindow] = {};
+    PackedPool* pool = nullptr;
+    size_t i = 0;
+
+    for(auto _ : state) {
+        if(pool == nullptr) {
+            pool = &g_packed_pools[state.thread_index()];
+        }
+        void*& slot = window[i++ % kWindow];
+        if(slot != nullptr) {
+            pool->Deallocate(slot);
+        }
+        slot = pool->Allocate();
+        benchmark::DoNotOptimize(slot);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_NeighbourPoolsPacked)->Arg(0)->Arg(1)->ThreadRange(1, 64)->UseRealTime();
+
+// Batch APIs against the equivalent loop of single calls.
+static void BM_PoolBatch(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    const size_t n = static_cast<size_t>(state.range(1));
+    std::vector<void*> ptrs(n);
+    for(auto _ : state) {
+        HashBucket::useMemoryBatch(size, ptrs.data(), n);
+        benchmark::DoNotOptimize(ptrs.data());
+        HashBucket::freeMemoryBatch(ptrs.data(), size, n);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_MemoryPoolBatch(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(1));
+    MemoryPool pool(static_cast<size_t>(state.range(0)), BlockSizePolicy{});
+    std::vector<void*> ptrs(n);
+    for(auto _ : state) {
+        pool.AllocateBatch(ptrs.data(), n);
+        benchmark::DoNotOptimize(ptrs.data());
+        pool.DeallocateBatch(ptrs.data(), n);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_MemoryPoolLoop(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(1));
+    MemoryPool pool(static_cast<size_t>(state.range(0)), BlockSizePolicy{});
+    std::vector<void*> ptrs(n);
+    for(auto _ : state) {
+        for(size_t i = 0; i < n; ++i) {
+            ptrs[i] = pool.Allocate();
+        }
+        benchmark::DoNotOptimize(ptrs.data());
+        for(size_t i = 0; i < n; ++i) {
+            pool.Deallocate(ptrs[i]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// 长时间随机释放之后，连续 1024 次分配落在多少个 block 上、写一遍要多久。
+// range(0) 选择空闲链表策略（0: Locked，2: PerBlock）。
+static void BM_ChurnedLocality(benchmark::State& state) {
+    constexpr size_t kSlots = size_t(1) << 16;
+    constexpr size_t kBurst = 1024;
+    MemoryPool pool(64, BlockSizePolicy{16 * 1024, 16 * 1024}, static_cast<FreeListPolicy>(state.range(0)));
+    std::vector<void*> ptrs(kSlots);
+    pool.AllocateBatch(ptrs.data(), kSlots);
+    std::mt19937 rng(42);
+    // 随机释放一半，使空闲槽散布在所有 block 上
+    std::shuffle(ptrs.begin(), ptrs.end(), rng);
+    for(size_t i = kSlots / 2; i < kSlots; ++i) {
+        pool.Deallocate(ptrs[i]);
+    }
+    ptrs.resize(kSlots / 2);
+    std::vector<void*> burst(kBurst);
+    double blocks = 0;
+    for(auto _ : state) {
+        std::set<const void*> touched;
+        for(void*& p : burst) {
+            p = pool.Allocate();
+            std::memset(p, 1, 64);
+        }
+        state.PauseTiming();
+        for(void* p : burst) {
+            touched.insert(PageMap::get(p));
+        }
+        blocks += static_cast<double>(touched.size());
+        state.ResumeTiming();
+        for(void* p : burst) {
+            pool.Deallocate(p);
+        }
+    }
+    state.counters["blocks_per_burst"] = blocks / static_cast<double>(state.iterations());
+    for(void* p : ptrs) {
+        pool.Deallocate(p);
+    }
+}
+BENCHMARK(BM_ChurnedLocality)->Arg(0)->Arg(2);
+
+// TLB pressure: touch a large working set of 64-byte slots in random order.
+// range(0) selects the block provider (0: operator new, 1: huge pages).
+static void BM_BlockProviderTouch(benchmark::State& state) {
+    constexpr size_t kSlots = size_t(1) << 20;  // 64 MiB of slots
+    MemoryPool pool(64, BlockSizePolicy{64 * 1024, 1024 * 1024});
+    if(state.range(0) == 1) {
+        pool.setBlockProvider(&HugePageBlockProvider::instance());
+    }
+    std::vector<void*> ptrs(kSlots);
+    pool.AllocateBatch(ptrs.data(), kSlots);
+    std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937_64(42));
+    size_t i = 0;
+    for(auto _ : state) {
+        long* slot = static_cast<long*>(ptrs[i++ & (kSlots - 1)]);
+        benchmark::DoNotOptimize(++*slot);
+    }
+    pool.DeallocateBatch(ptrs.data(), kSlots);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_BlockProviderTouch)->Arg(0)->Arg(1);
+
+// Node containers with std::allocator against PoolAllocator.
+template<template<typename> class Alloc>
+static void BM_ListPushPop(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    std::list<long, Alloc<long>> list;
+    for(auto _ : state) {
+        for(size_t i = 0; i < n; ++i) {
+            list.push_back(static_cast<long>(i));
+        }
+        benchmark::DoNotOptimize(list.back());
+        list.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template<template<typename> class Alloc>
+static void BM_MapInsertErase(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    std::map<long, long, std::less<long>, Alloc<std::pair<const long, long>>> map;
+    for(auto _ : state) {
+        for(size_t i = 0; i < n; ++i) {
+            map.emplace(static_cast<long>(i * 7919 % n), static_cast<long>(i));
+        }
+        benchmark::DoNotOptimize(map.size());
+        map.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_ListPushPop, std::allocator)->Arg(1024);
+BENCHMARK_TEMPLATE(BM_ListPushPop, PoolAllocator)->Arg(1024);
+BENCHMARK_TEMPLATE(BM_MapInsertErase, std::allocator)->Arg(1024);
+BENCHMARK_TEMPLATE(BM_MapInsertErase, PoolAllocator)->Arg(1024);
+
+// Typed entry points, as used by callers of newElement/deleteElement.
+struct Node {
+    Node* next;
+    long payload[5];
+};
+
+static void BM_NewElement(benchmark::State& state) {
+    for(auto _ : state) {
+        Node* node = newElement<Node>();
+        benchmark::DoNotOptimize(node);
+        deleteElement(node);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_NewExpression(benchmark::State& state) {
+    for(auto _ : state) {
+        Node* node = new Node();
+        benchmark::DoNotOptimize(node);
+        delete node;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<ObjectReuse Reuse>
+static void BM_ObjectPool(benchmark::State& state) {
+    static ObjectPool<Node, 4096, Reuse> pool;
+    for(auto _ : state) {
+        Node* node = pool.newElement();
+        benchmark::DoNotOptimize(node);
+        pool.deleteElement(node);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// An object whose constructor allocates: KeepConstructed skips it on reuse
+struct Buffered {
+    Buffered() { data.reserve(256); }
+    std::vector<char> data;
+};
+
+template<ObjectReuse Reuse>
+static void BM_ObjectPoolBuffered(benchmark::State& state) {
+    static ObjectPool<Buffered, 4096, Reuse> pool;
+    for(auto _ : state) {
+        Buffered* object = pool.newElement();
+        benchmark::DoNotOptimize(object->data.data());
+        pool.deleteElement(object);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 一次"请求"里分配 state.range(0) 个大小不一的临时对象，然后全部丢弃：
+// Arena 逐个 bump、最后一次性归还；HashBucket 逐个分配、逐个释放
+static void BM_ScratchArena(benchmark::State& state) {
+    const int count = static_cast<int>(state.range(0));
+    for(auto _ : state) {
+        Arena arena;
+        for(int i = 0; i < count; ++i) {
+            benchmark::DoNotOptimize(arena.allocate(16 + (i & 7) * 24));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+static void BM_ScratchHashBucket(benchmark::State& state) {
+    const int count = static_cast<int>(state.range(0));
+    std::vector<void*> ptrs(count);
+    for(auto _ : state) {
+        for(int i = 0; i < count; ++i) {
+            ptrs[i] = HashBucket::useMemory(16 + (i & 7) * 24);
+            benchmark::DoNotOptimize(ptrs[i]);
+        }
+        for(int i = 0; i < count; ++i) {
+            HashBucket::freeMemory(ptrs[i], 16 + (i & 7) * 24);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+// 64 字节分配/释放：range(0) 为 0 时采样关闭，否则按 range(0) 字节的平均间隔采样
+static void BM_SampledAllocFree(benchmark::State& state) {
+    if(state.range(0) != 0) {
+        HeapProfiler::start(static_cast<size_t>(state.range(0)));
+    }
+    for(auto _ : state) {
+        void* ptr = HashBucket::useMemory(64);
+        benchmark::DoNotOptimize(ptr);
+        HashBucket::freeMemory(ptr, 64);
+    }
+    HeapProfiler::stop();
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 缓冲区从 16 字节按 1.5 倍增长到 range(0) 字节：reallocMemory 对比 分配 + memcpy + 释放
+static void BM_ReallocGrow(benchmark::State& state) {
+    const size_t limit = static_cast<size_t>(state.range(0));
+    for(auto _ : state) {
+        size_t size = 16;
+        void* buf = HashBucket::useMemory(size);
+        while(size < limit) {
+            const size_t next = size + size / 2;
+            buf = HashBucket::reallocMemory(buf, size, next);
+            size = next;
+        }
+        benchmark::DoNotOptimize(buf);
+        HashBucket::freeMemory(buf, size);
+    }
+}
+
+static void BM_CopyGrow(benchmark::State& state) {
+    const size_t limit = static_cast<size_t>(state.range(0));
+    for(auto _ : state) {
+        size_t size = 16;
+        void* buf = HashBucket::useMemory(size);
+        while(size < limit) {
+            const size_t next = size + size / 2;
+            void* grown = HashBucket::useMemory(next);
+            std::memcpy(grown, buf, size);
+            HashBucket::freeMemory(buf, size);
+            buf = grown;
+            size = next;
+        }
+        benchmark::DoNotOptimize(buf);
+        HashBucket::freeMemory(buf, size);
+    }
+}
+
+BENCHMARK(BM_NewElement);
+BENCHMARK(BM_NewExpression);
+BENCHMARK_TEMPLATE(BM_ObjectPool, ObjectReuse::Destroy);
+BENCHMARK_TEMPLATE(BM_ObjectPool, ObjectReuse::KeepConstructed);
+BENCHMARK_TEMPLATE(BM_ObjectPoolBuffered, ObjectReuse::Destroy);
+BENCHMARK_TEMPLATE(BM_ObjectPoolBuffered, ObjectReuse::KeepConstructed);
+BENCHMARK(BM_ScratchArena)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_ScratchHashBucket)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_SampledAllocFree)->Arg(0)->Arg(512 * 1024)->Arg(4096);
+BENCHMARK(BM_ReallocGrow)->Arg(4096)->Arg(16 << 20);
+BENCHMARK(BM_CopyGrow)->Arg(4096)->Arg(16 << 20);
+
+#define ZP_REGISTER_ALLOCATOR(Alloc)                                                        \
+    BENCHMARK_TEMPLATE(BM_AllocFree, Alloc)->RangeMultiplier(4)->Range(8, 32768);            \
+    BENCHMARK_TEMPLATE(BM_AllocFree, Alloc)->Arg(64)->ThreadRange(1, 64)->UseRealTime();     \
+    BENCHMARK_TEMPLATE(BM_BurstAllocFree, Alloc)->Arg(64)->Arg(1024)->ThreadRange(1, 64)->UseRealTime(); \
+    BENCHMARK_TEMPLATE(BM_RandomChurn, Alloc)->Arg(512)->Arg(8192)->ThreadRange(1, 64)->UseRealTime();   \
+    BENCHMARK_TEMPLATE(BM_CrossThreadFree, Alloc)->Arg(64)->ThreadRange(2, 64)->UseRealTime()
+
+ZP_REGISTER_ALLOCATOR(HashBucketAllocator);
+ZP_REGISTER_ALLOCATOR(NewDeleteAllocator);
+ZP_REGISTER_ALLOCATOR(MallocAllocator);
+#if defined(ZP_BENCH_JEMALLOC)
+ZP_REGISTER_ALLOCATOR(JemallocAllocator);
+#endif
+#if defined(ZP_BENCH_MIMALLOC)
+ZP_REGISTER_ALLOCATOR(MimallocAllocator);
+#endif
+
+BENCHMARK(BM_PoolBatch)->ArgsProduct({{64, 1024}, {16, 256}});
+BENCHMARK(BM_MemoryPoolBatch)->ArgsProduct({{64, 1024}, {16, 256}});
+BENCHMARK(BM_MemoryPoolLoop)->ArgsProduct({{64, 1024}, {16, 256}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,705 @@
+// Long-running concurrency stress and scalability harness.
+//
+// Every thread keeps a window of live allocations and replaces a random
+// victim per operation; a configurable share of the victims is handed to the
+// neighbouring thread and freed there. Each block carries a tag that is
+// checked before it is freed, so lost updates in the allocator show up as
+// corrupted or duplicated blocks instead of going unnoticed. Results: one
+// row per allocator and thread count with throughput, speedup over the first
+// thread count, sampled allocation/free latency percentiles and peak RSS.
+//
+//   ./stress --threads=1,2,4,8 --seconds=30 --trace=stats.txt --csv=stress.csv
+//   ./stress --help
+//
+// jemalloc and mimalloc replace malloc for the whole process once linked, so
+// they live in their own binaries (stress_jemalloc, stress_mimalloc); run
+// them with the same arguments and the same --csv file to get one table.
+#include "ZPmemoryPool.h"
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(ZP_BENCH_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#define ZP_STRESS_STR2(x) #x
+#define ZP_STRESS_STR(x) ZP_STRESS_STR2(x)
+#endif
+#if defined(ZP_BENCH_MIMALLOC)
+#include <mimalloc.h>
+#endif
+
+using namespace ZPmemoryPool;
+
+namespace {
+
+// Allocators under test ------------------------------------------------------
+
+struct Allocator {
+    const char* name;
+    void* (*allocate)(size_t size);
+    void (*deallocate)(void* ptr, size_t size);
+    void (*trim)();     // give cached memory back between runs (may be null)
+};
+
+// A pool family without thread caches: every call reaches the shared
+// MemoryPool, which is what the free-list races need to be exposed.
+struct LockedFamilyConfig : DefaultPoolConfig {};
+struct LockFreeFamilyConfig : DefaultPoolConfig {
+    static constexpr FreeListPolicy kFreeListPolicy = FreeListPolicy::LockFree;
+};
+struct PerBlockFamilyConfig : DefaultPoolConfig {
+    static constexpr FreeListPolicy kFreeListPolicy = FreeListPolicy::PerBlock;
+};
+
+template<typename Family>
+Allocator familyAllocator(const char* name) {
+    return {name,
+            [](size_t size) { return Family::useMemory(size); },
+            [](void* ptr, size_t size) { Family::freeMemory(ptr, size); },
+            [] { Family::trim(); }};
+}
+
+std::vector<Allocator> allAllocators() {
+    std::vector<Allocator> all = {
+        {"zp", [](size_t size) { return HashBucket::useMemory(size); },
+               [](void* ptr, size_t size) { HashBucket::freeMemory(ptr, size); },
+               [] { HashBucket::trimAll(); }},
+        {"zp-unsized", [](size_t size) { return HashBucket::useMemory(size); },
+                       [](void* ptr, size_t) { HashBucket::freeMemory(ptr); },
+                       [] { HashBucket::trimAll(); }},
+        familyAllocator<BasicHashBucket<LockedFamilyConfig>>("zp-locked"),
+        familyAllocator<BasicHashBucket<LockFreeFamilyConfig>>("zp-lockfree"),
+        familyAllocator<BasicHashBucket<PerBlockFamilyConfig>>("zp-perblock"),
+        {"malloc", [](size_t size) { return std::malloc(size); },
+                   [](void* ptr, size_t) { std::free(ptr); },
+#if defined(__GLIBC__)
+                   [] { malloc_trim(0); }},
+#else
+                   nullptr},
+#endif
+    };
+#if defined(ZP_BENCH_JEMALLOC)
+    all.push_back({"jemalloc", [](size_t size) { return mallocx(size, 0); },
+                               [](void* ptr, size_t size) { sdallocx(ptr, size, 0); },
+                               [] { mallctl("arena." ZP_STRESS_STR(MALLCTL_ARENAS_ALL) ".purge", nullptr, nullptr, nullptr, 0); }});
+#endif
+#if defined(ZP_BENCH_MIMALLOC)
+    all.push_back({"mimalloc", [](size_t size) { return mi_malloc(size); },
+                               [](void* ptr, size_t size) { mi_free_size(ptr, size); },
+                               [] { mi_collect(true); }});
+#endif
+    return all;
+}
+
+// Allocators run when --allocators is not given: the one this binary was
+// linked for, against the pools.
+const char* defaultAllocators() {
+#if defined(ZP_BENCH_JEMALLOC)
+    return "zp,jemalloc";
+#elif defined(ZP_BENCH_MIMALLOC)
+    return "zp,mimalloc";
+#else
+    return "zp,zp-locked,malloc";
+#endif
+}
+
+// Options --------------------------------------------------------------------
+
+struct Options {
+    std::vector<std::string> allocators;
+    std::vector<int> threads{1, 2, 4, 8};
+    uint64_t ops = 2'000'000;       // operations per thread
+    double seconds = 0;             // > 0: run each configuration this long instead of `ops`
+    size_t live = 4096;             // live blocks per thread
+    double cross = 0.25;            // share of frees done by the neighbouring thread
+    uint64_t sample_every = 16;     // time one operation in this many
+    size_t min_size = 8;
+    size_t max_size = 1024;
+    std::string trace;              // size distribution file, see loadTrace()
+    std::string csv;                // append result rows to this file
+    uint64_t seed = 1;
+    bool verify = true;
+};
+
+void usage() {
+    std::cout <<
+        "usage: stress [options]\n"
+        "  --allocators=a,b,...  allocators to run (default: " << defaultAllocators() << ")\n"
+        "  --threads=1,2,4,8     thread counts, one run each\n"
+        "  --ops=N               operations per thread and run (default 2000000)\n"
+        "  --seconds=S           run each configuration for S seconds instead of --ops\n"
+        "  --live=N              live blocks per thread (default 4096)\n"
+        "  --cross=F             share of frees done by another thread, 0..1 (default 0.25)\n"
+        "  --sizes=MIN-MAX       log-uniform size range without a trace (default 8-1024)\n"
+        "  --trace=FILE          size distribution: a HashBucket::dumpStats() table,\n"
+        "                        or lines of \"size [count]\" ('#' starts a comment)\n"
+        "  --sample-every=N      time one operation in N (default 16)\n"
+        "  --seed=N              random seed (default 1)\n"
+        "  --no-verify           do not tag and check blocks\n"
+        "  --csv=FILE            append result rows to FILE\n"
+        "available allocators:";
+    for (const Allocator& a : allAllocators()) {
+        std::cout << ' ' << a.name;
+    }
+    std::cout << '\n';
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+[[noreturn]] void die(const std::string& message) {
+    std::cerr << "stress: " << message << '\n';
+    std::exit(2);
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options opt;
+    opt.allocators = splitList(defaultAllocators());
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        const std::string key = arg.substr(0, eq);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        try {
+            if (key == "--help" || key == "-h") {
+                usage();
+                std::exit(0);
+            } else if (key == "--allocators") {
+                opt.allocators = splitList(value);
+            } else if (key == "--threads") {
+                opt.threads.clear();
+                for (const std::string& t : splitList(value)) {
+                    opt.threads.push_back(std::max(1, std::stoi(t)));
+                }
+            } else if (key == "--ops") {
+                opt.ops = std::stoull(value);
+            } else if (key == "--seconds") {
+                opt.seconds = std::stod(value);
+            } else if (key == "--live") {
+                opt.live = std::max<size_t>(1, std::stoull(value));
+            } else if (key == "--cross") {
+                opt.cross = std::clamp(std::stod(value), 0.0, 1.0);
+            } else if (key == "--sizes") {
+                const size_t dash = value.find('-');
+                opt.min_size = std::max<size_t>(1, std::stoull(value.substr(0, dash)));
+                opt.max_size = dash == std::string::npos ? opt.min_size : std::stoull(value.substr(dash + 1));
+                opt.max_size = std::max(opt.max_size, opt.min_size);
+            } else if (key == "--trace") {
+                opt.trace = value;
+            } else if (key == "--sample-every") {
+                opt.sample_every = std::max<uint64_t>(1, std::stoull(value));
+            } else if (key == "--seed") {
+                opt.seed = std::stoull(value);
+            } else if (key == "--no-verify") {
+                opt.verify = false;
+            } else if (key == "--csv") {
+                opt.csv = value;
+            } else {
+                die("unknown option " + arg + " (see --help)");
+            }
+        } catch (const std::logic_error&) {
+            die("bad value in " + arg);
+        }
+    }
+    if (opt.threads.empty()) {
+        die("--threads is empty");
+    }
+    return opt;
+}
+
+// Size distribution ------------------------------------------------------------
+
+// A weighted range of request sizes; a size is drawn uniformly from [lo, hi].
+struct SizeBucket {
+    size_t lo;
+    size_t hi;
+    double weight;
+};
+
+// Reads either a HashBucket::dumpStats() table recorded in production (each
+// class weighted by its allocation count, sizes spread over the bytes the
+// class serves) or a plain list of "size [count]" lines.
+std::vector<SizeBucket> loadTrace(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        die("cannot open trace " + path);
+    }
+    std::vector<SizeBucket> buckets;
+    if (in.peek() == 's') {
+        const auto stats = HashBucket::parseStats(in);
+        for (size_t i = 0; i < stats.size(); ++i) {
+            if (stats[i].allocations != 0) {
+                const size_t lo = i == 0 ? 1 : SizeClass::size(i - 1) + 1;
+                buckets.push_back({lo, SizeClass::size(i), static_cast<double>(stats[i].allocations)});
+            }
+        }
+    } else {
+        for (std::string line; std::getline(in, line);) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            size_t size = 0;
+            double count = 1;
+            if (!(fields >> size) || size == 0) {
+                continue;
+            }
+            fields >> count;
+            buckets.push_back({size, size, count});
+        }
+    }
+    if (buckets.empty()) {
+        die("trace " + path + " has no sizes");
+    }
+    return buckets;
+}
+
+// Pre-drawn sizes, so the random generator stays out of the timed region.
+std::vector<size_t> makeSizeTable(const Options& opt, const std::vector<SizeBucket>& buckets) {
+    std::vector<size_t> sizes(1 << 16);
+    std::mt19937_64 rng(opt.seed);
+    if (buckets.empty()) {
+        std::uniform_real_distribution<double> exponent(std::log2(static_cast<double>(opt.min_size)),
+                                                        std::log2(static_cast<double>(opt.max_size) + 1));
+        for (size_t& size : sizes) {
+            size = std::clamp(static_cast<size_t>(std::exp2(exponent(rng))), opt.min_size, opt.max_size);
+        }
+        return sizes;
+    }
+    std::vector<double> weights;
+    for (const SizeBucket& b : buckets) {
+        weights.push_back(b.weight);
+    }
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    for (size_t& size : sizes) {
+        const SizeBucket& b = buckets[pick(rng)];
+        size = std::uniform_int_distribution<size_t>(b.lo, b.hi)(rng);
+    }
+    return sizes;
+}
+
+// Latency histogram --------------------------------------------------------------
+
+// Log-linear buckets: 16 per power of two, so percentiles are within 6.25%.
+class LatencyHistogram {
+public:
+    void add(uint64_t ns) { ++counts_[bucket(ns)]; ++total_; }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+    }
+
+    // Lower bound of the bucket holding quantile q, in nanoseconds
+    uint64_t percentile(double q) const {
+        const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen > rank) {
+                return lowerBound(i);
+            }
+        }
+        return 0;
+    }
+
+private:
+    static constexpr int kSubBits = 4;
+
+    static size_t bucket(uint64_t ns) {
+        if (ns < (1u << kSubBits)) {
+            return ns;
+        }
+        const int msb = std::bit_width(ns) - 1;
+        return static_cast<size_t>(msb - kSubBits + 1) << kSubBits | ((ns >> (msb - kSubBits)) & ((1u << kSubBits) - 1));
+    }
+
+    static uint64_t lowerBound(size_t index) {
+        if (index < (1u << kSubBits)) {
+            return index;
+        }
+        const int msb = static_cast<int>(index >> kSubBits) + kSubBits - 1;
+        return ((uint64_t(1) << kSubBits) | (index & ((1u << kSubBits) - 1))) << (msb - kSubBits);
+    }
+
+    std::array<uint64_t, 64 << kSubBits> counts_{};
+    uint64_t total_ = 0;
+};
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Cost of one timed region with nothing in it, reported next to the percentiles
+uint64_t timerOverheadNs() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; ++i) {
+        const uint64_t t0 = nowNs();
+        best = std::min(best, nowNs() - t0);
+    }
+    return best;
+}
+
+// Resident set size ------------------------------------------------------------
+
+// VmHWM/VmRSS in /proc/self/status, in KiB (0 where unavailable)
+size_t statusKiB(const char* field) {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind(field, 0) == 0) {
+            return std::strtoull(line.c_str() + std::strlen(field), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+// Writing 5 to clear_refs resets VmHWM to the current RSS (Linux 4.0+)
+bool resetPeakRss() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+    clear.flush();
+    return static_cast<bool>(clear);
+}
+
+// The run ----------------------------------------------------------------------
+
+struct Block {
+    void* ptr = nullptr;
+    size_t size = 0;
+    uint64_t tag = 0;
+};
+
+// Single-producer/single-consumer ring: thread i hands blocks to thread i + 1.
+struct alignas(CACHE_LINE_SIZE) Mailbox {
+    static constexpr size_t kCapacity = 1024;
+    std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+    alignas(CACHE_LINE_SIZE) Block blocks[kCapacity];
+
+    bool push(const Block& b) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == kCapacity) {
+            return false;
+        }
+        blocks[t % kCapacity] = b;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Block& b) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        b = blocks[h % kCapacity];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+struct ThreadResult {
+    uint64_t ops = 0;
+    uint64_t end_ns = 0;
+    LatencyHistogram alloc_latency;
+    LatencyHistogram free_latency;
+};
+
+struct Run {
+    const Options& opt;
+    const Allocator& alloc;
+    const std::vector<size_t>& sizes;
+    int threads;
+    std::unique_ptr<Mailbox[]> mailboxes;
+    std::vector<ThreadResult> results;
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::atomic<int> finished{0};
+    uint64_t start_ns = 0;
+};
+
+// The first bytes of a block hold its tag and the last byte repeats the
+// tag's low byte; the middle is not touched
+void writeTag(const Block& b) {
+    std::memcpy(b.ptr, &b.tag, std::min(b.size, sizeof(b.tag)));
+    if (b.size > sizeof(b.tag)) {
+        static_cast<unsigned char*>(b.ptr)[b.size - 1] = static_cast<unsigned char>(b.tag);
+    }
+}
+
+void checkTag(const Block& b) {
+    uint64_t tag = 0;
+    std::memcpy(&tag, b.ptr, std::min(b.size, sizeof(tag)));
+    uint64_t expected = 0;
+    std::memcpy(&expected, &b.tag, std::min(b.size, sizeof(expected)));
+    const bool tail_ok = b.size <= sizeof(b.tag)
+                      || static_cast<unsigned char*>(b.ptr)[b.size - 1] == static_cast<unsigned char>(b.tag);
+    if (tag != expected || !tail_ok) {
+        std::fprintf(stderr, "stress: block %p of %zu bytes (tag %016llx) was overwritten\n",
+                     b.ptr, b.size, static_cast<unsigned long long>(b.tag));
+        std::abort();
+    }
+}
+
+void worker(Run& run, int id) {
+    const Options& opt = run.opt;
+    const Allocator& alloc = run.alloc;
+    ThreadResult& result = run.results[id];
+    Mailbox& inbox = run.mailboxes[id];
+    Mailbox& outbox = run.mailboxes[(id + 1) % run.threads];
+    const bool cross = run.threads > 1 && opt.cross > 0;
+    const uint64_t cross_threshold = static_cast<uint64_t>(opt.cross * 65536.0);
+    const size_t mask = run.sizes.size() - 1;
+
+    std::vector<Block> live(opt.live);
+    uint64_t rng = opt.seed * 0x9E3779B97F4A7C15ull + static_cast<uint64_t>(id) + 1;
+    auto next = [&rng] {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return rng;
+    };
+    uint64_t serial = static_cast<uint64_t>(id) << 48;
+    size_t size_pos = static_cast<size_t>(next());
+
+    auto release = [&](const Block& b, bool timed) {
+        if (opt.verify) {
+            checkTag(b);
+        }
+        if (timed) {
+            const uint64_t t0 = nowNs();
+            alloc.deallocate(b.ptr, b.size);
+            result.free_latency.add(nowNs() - t0);
+        } else {
+            alloc.deallocate(b.ptr, b.size);
+        }
+    };
+
+    run.ready.fetch_add(1, std::memory_order_release);
+    while (!run.go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    uint64_t op = 0;
+    for (;; ++op) {
+        if (opt.seconds > 0 ? (op % 256 == 0 && run.stop.load(std::memory_order_relaxed)) : op == opt.ops) {
+            break;
+        }
+        const bool timed = op % opt.sample_every == 0;
+        if (Block in; cross && inbox.pop(in)) {
+            release(in, false);
+        }
+        Block& victim = live[next() % live.size()];
+        if (victim.ptr != nullptr) {
+            if (!(cross && (next() & 0xFFFF) < cross_threshold && outbox.push(victim))) {
+                release(victim, timed);
+            }
+        }
+        victim.size = run.sizes[size_pos++ & mask];
+        victim.tag = ++serial;
+        if (timed) {
+            const uint64_t t0 = nowNs();
+            victim.ptr = alloc.allocate(victim.size);
+            result.alloc_latency.add(nowNs() - t0);
+        } else {
+            victim.ptr = alloc.allocate(victim.size);
+        }
+        if (victim.ptr == nullptr) {
+            std::fprintf(stderr, "stress: %s returned nullptr for %zu bytes\n", alloc.name, victim.size);
+            std::abort();
+        }
+        if (opt.verify) {
+            writeTag(victim);
+        }
+    }
+    result.ops = op;
+    result.end_ns = nowNs();
+
+    for (Block& b : live) {
+        if (b.ptr != nullptr) {
+            release(b, false);
+        }
+    }
+    // Keep taking blocks from the previous thread until it can send no more
+    run.finished.fetch_add(1, std::memory_order_acq_rel);
+    for (;;) {
+        const bool all_done = run.finished.load(std::memory_order_acquire) == run.threads;
+        Block in;
+        bool drained = false;
+        while (cross && inbox.pop(in)) {
+            release(in, false);
+            drained = true;
+        }
+        if (all_done && !drained) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+}
+
+struct Row {
+    std::string allocator;
+    int threads;
+    uint64_t ops;
+    double seconds;
+    double mops;
+    double speedup;
+    uint64_t alloc_p50, alloc_p99, alloc_p999;
+    uint64_t free_p50, free_p99, free_p999;
+    size_t rss_base_kib;
+    size_t rss_peak_kib;
+};
+
+Row runOnce(const Options& opt, const Allocator& alloc, const std::vector<size_t>& sizes, int threads) {
+    if (alloc.trim) {
+        alloc.trim();
+    }
+    resetPeakRss();
+    Row row{};
+    row.allocator = alloc.name;
+    row.threads = threads;
+    row.rss_base_kib = statusKiB("VmRSS:");
+
+    Run run{opt, alloc, sizes, threads, std::make_unique<Mailbox[]>(static_cast<size_t>(threads)),
+            std::vector<ThreadResult>(static_cast<size_t>(threads))};
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i) {
+        pool.emplace_back(worker, std::ref(run), i);
+    }
+    while (run.ready.load(std::memory_order_acquire) != threads) {
+        std::this_thread::yield();
+    }
+    run.start_ns = nowNs();
+    run.go.store(true, std::memory_order_release);
+    if (opt.seconds > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(opt.seconds));
+        run.stop.store(true, std::memory_order_relaxed);
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+
+    LatencyHistogram alloc_latency;
+    LatencyHistogram free_latency;
+    uint64_t end_ns = run.start_ns;
+    for (const ThreadResult& r : run.results) {
+        row.ops += r.ops;
+        end_ns = std::max(end_ns, r.end_ns);
+        alloc_latency.merge(r.alloc_latency);
+        free_latency.merge(r.free_latency);
+    }
+    row.seconds = static_cast<double>(end_ns - run.start_ns) * 1e-9;
+    row.mops = row.seconds > 0 ? static_cast<double>(row.ops) / row.seconds * 1e-6 : 0;
+    row.alloc_p50 = alloc_latency.percentile(0.50);
+    row.alloc_p99 = alloc_latency.percentile(0.99);
+    row.alloc_p999 = alloc_latency.percentile(0.999);
+    row.free_p50 = free_latency.percentile(0.50);
+    row.free_p99 = free_latency.percentile(0.99);
+    row.free_p999 = free_latency.percentile(0.999);
+    row.rss_peak_kib = statusKiB("VmHWM:");
+    return row;
+}
+
+void printRow(const Row& r) {
+    std::printf("%-12s %7d %11.2f %8.2fx %8llu %8llu %8llu %8llu %8llu %8llu %9.1f %9.1f\n",
+                r.allocator.c_str(), r.threads, r.mops, r.speedup,
+                static_cast<unsigned long long>(r.alloc_p50), static_cast<unsigned long long>(r.alloc_p99),
+                static_cast<unsigned long long>(r.alloc_p999), static_cast<unsigned long long>(r.free_p50),
+                static_cast<unsigned long long>(r.free_p99), static_cast<unsigned long long>(r.free_p999),
+                static_cast<double>(r.rss_base_kib) / 1024.0, static_cast<double>(r.rss_peak_kib) / 1024.0);
+    std::fflush(stdout);
+}
+
+void appendCsv(const std::string& path, const std::vector<Row>& rows) {
+    const bool fresh = !std::ifstream(path).good();
+    std::ofstream out(path, std::ios::app);
+    if (!out) {
+        die("cannot write " + path);
+    }
+    if (fresh) {
+        out << "allocator,threads,ops,seconds,mops,speedup,alloc_p50_ns,alloc_p99_ns,alloc_p999_ns,"
+               "free_p50_ns,free_p99_ns,free_p999_ns,rss_base_kib,rss_peak_kib\n";
+    }
+    for (const Row& r : rows) {
+        out << r.allocator << ',' << r.threads << ',' << r.ops << ',' << r.seconds << ',' << r.mops << ','
+            << r.speedup << ',' << r.alloc_p50 << ',' << r.alloc_p99 << ',' << r.alloc_p999 << ','
+            << r.free_p50 << ',' << r.free_p99 << ',' << r.free_p999 << ',' << r.rss_base_kib << ','
+            << r.rss_peak_kib << '\n';
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const Options opt = parseOptions(argc, argv);
+
+    std::vector<Allocator> selected;
+    const std::vector<Allocator> all = allAllocators();
+    for (const std::string& name : opt.allocators) {
+        auto it = std::find_if(all.begin(), all.end(), [&](const Allocator& a) { return name == a.name; });
+        if (it == all.end()) {
+            die("allocator " + name + " is not available in this binary (see --help)");
+        }
+        selected.push_back(*it);
+    }
+
+    const std::vector<SizeBucket> buckets = opt.trace.empty() ? std::vector<SizeBucket>() : loadTrace(opt.trace);
+    const std::vector<size_t> sizes = makeSizeTable(opt, buckets);
+
+    std::printf("# %s; live %zu per thread, cross-thread frees %.0f%%, 1 in %llu operations timed (timer overhead %llu ns)%s\n",
+                opt.seconds > 0 ? (std::to_string(opt.seconds) + " s per run").c_str()
+                                : (std::to_string(opt.ops) + " operations per thread").c_str(),
+                opt.live, opt.cross * 100.0, static_cast<unsigned long long>(opt.sample_every),
+                static_cast<unsigned long long>(timerOverheadNs()), resetPeakRss() ? "" : "; peak RSS not resettable, cumulative");
+    std::printf("# sizes: %s\n", opt.trace.empty()
+                ? ("log-uniform " + std::to_string(opt.min_size) + "-" + std::to_string(opt.max_size)).c_str()
+                : opt.trace.c_str());
+    std::printf("%-12s %7s %11s %9s %8s %8s %8s %8s %8s %8s %9s %9s\n", "allocator", "threads", "Mops/s", "speedup",
+                "a.p50ns", "a.p99ns", "a.p999ns", "f.p50ns", "f.p99ns", "f.p999ns", "rss0 MiB", "peak MiB");
+
+    std::vector<Row> rows;
+    for (const Allocator& alloc : selected) {
+        double base = 0;
+        for (int threads : opt.threads) {
+            Row row = runOnce(opt, alloc, sizes, threads);
+            if (base == 0) {
+                base = row.mops;
+            }
+            // Throughput relative to the first thread count of this allocator
+            row.speedup = base > 0 ? row.mops / base : 0;
+            printRow(row);
+            rows.push_back(row);
+        }
+    }
+    if (!opt.csv.empty()) {
+        appendCsv(opt.csv, rows);
+    }
+    return 0;
+}
@@ -1,10 +1,26 @@
 #include <gtest/gtest.h>
 #include "ZPmemoryPool.h"
+#include "PoolAllocator.h"
+#include "ObjectPool.h"
+#include "Arena.h"
+#include "HeapProfiler.h"
 #include <thread>
 #include <vector>
 #include <atomic>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 using namespace ZPmemoryPool;
 
@@ -85,9 +101,209 @@ TEST_F(MemoryPoolTest, HashBucketBasicUsage) {
 
 TEST_F(MemoryPoolTest, HashBucketLargeAllocation) {
     // Test allocation larger than MAX_SLOT_SIZE
-    void* ptr = HashBucket::useMemory(1024);
+    void* ptr = HashBucket::useMemory(MAX_SLOT_SIZE * 2);
     ASSERT_NE(ptr, nullptr);
-    HashBucket::freeMemory(ptr, 1024);
+    HashBucket::freeMemory(ptr, MAX_SLOT_SIZE * 2);
+}
+
+TEST_F(MemoryPoolTest, HashBucketRealloc) {
+    auto fill = [](void* p, size_t n, unsigned char seed) {
+        auto* bytes = static_cast<unsigned char*>(p);
+        for(size_t i = 0; i < n; ++i) {
+            bytes[i] = static_cast<unsigned char>(seed + i * 7);
+        }
+    };
+    auto holds = [](const void* p, size_t n, unsigned char seed) {
+        const auto* bytes = static_cast<const unsigned char*>(p);
+        for(size_t i = 0; i < n; ++i) {
+            if(bytes[i] != static_cast<unsigned char>(seed + i * 7)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Same size class: the slot already fits
+    void* p = HashBucket::reallocMemory(nullptr, 0, 50);
+    ASSERT_NE(p, nullptr);
+    fill(p, 50, 1);
+    EXPECT_EQ(HashBucket::reallocMemory(p, 50, 56), p);
+
+    // Another class: moved, contents kept
+    void* q = HashBucket::reallocMemory(p, 56, 3000);
+    ASSERT_NE(q, nullptr);
+    EXPECT_TRUE(holds(q, 50, 1));
+    fill(q, 3000, 2);
+
+    // From a slot to a mapped allocation and through mremap
+    const size_t big = HashBucket::kMapThreshold + 12345;
+    void* m = HashBucket::reallocMemory(q, 3000, big);
+    ASSERT_NE(m, nullptr);
+    EXPECT_TRUE(holds(m, 3000, 2));
+    ASSERT_NE(PageMap::get(m), nullptr);
+    EXPECT_EQ(PageMap::get(m)->owner, nullptr);
+    fill(m, big, 3);
+    EXPECT_EQ(HashBucket::reallocMemory(m, big, big + 16), m);
+
+    const size_t huge = 16 * 1024 * 1024;
+    void* g = HashBucket::reallocMemory(m, big + 16, huge);
+    ASSERT_NE(g, nullptr);
+    EXPECT_TRUE(holds(g, big, 3));
+    EXPECT_EQ(PageMap::get(static_cast<char*>(g) + huge - 1), PageMap::get(g));
+    fill(g, huge, 4);
+
+    void* s = HashBucket::reallocMemory(g, huge, big);
+    ASSERT_NE(s, nullptr);
+    EXPECT_TRUE(holds(s, big, 4));
+    EXPECT_EQ(PageMap::get(static_cast<char*>(s) + huge - 1), nullptr);
+
+    // Between MAX_SLOT_SIZE and kMapThreshold memory comes from operator new
+    void* mid = HashBucket::reallocMemory(s, big, MAX_SLOT_SIZE + 100);
+    ASSERT_NE(mid, nullptr);
+    EXPECT_TRUE(holds(mid, MAX_SLOT_SIZE + 100, 4));
+    EXPECT_EQ(PageMap::get(mid), nullptr);
+    EXPECT_EQ(HashBucket::reallocMemory(mid, MAX_SLOT_SIZE + 100, 0), nullptr);
+
+    // Mapped allocations are found without their size too
+    void* unsized = HashBucket::useMemory(big);
+    HashBucket::freeMemory(unsized);
+    EXPECT_EQ(PageMap::get(unsized), nullptr);
+}
+
+TEST_F(MemoryPoolTest, SizeClassTable) {
+    EXPECT_EQ(SizeClass::size(0), 8u);
+    EXPECT_EQ(SizeClass::size(7), 64u);
+    EXPECT_EQ(SizeClass::size(8), 80u);
+    EXPECT_EQ(SizeClass::size(MEMORY_POOL_NUM - 1), static_cast<size_t>(MAX_SLOT_SIZE));
+
+    // index() must pick the smallest class that fits, for every size
+    for(size_t size = 1; size <= MAX_SLOT_SIZE; ++size) {
+        size_t index = SizeClass::index(size);
+        ASSERT_LT(index, static_cast<size_t>(MEMORY_POOL_NUM)) << size;
+        ASSERT_GE(SizeClass::size(index), size) << size;
+        if(index > 0) {
+            ASSERT_LT(SizeClass::size(index - 1), size) << size;
+        }
+    }
+}
+
+// A family with its own compile-time size classes, policies and pools
+struct WideClassesConfig : DefaultPoolConfig {
+    static constexpr size_t kSpacing = 16;
+    static constexpr size_t kLinearMax = 128;
+    static constexpr size_t kClassesPerDoubling = 2;
+    static constexpr size_t kMaxSize = 4096;
+    static constexpr FreeListPolicy kFreeListPolicy = FreeListPolicy::PerBlock;
+    static constexpr BlockSizePolicy blockSizePolicy(size_t) { return {8192, 8192}; }
+};
+using WideFamily = BasicHashBucket<WideClassesConfig>;
+
+namespace {
+
+struct FamilyBase {
+    virtual ~FamilyBase() = default;
+    int id = 0;
+};
+
+struct FamilyMixin {
+    virtual ~FamilyMixin() = default;
+    long tag = 0;
+};
+
+// In a larger class than FamilyBase, with FamilyMixin at a non-zero offset
+struct FamilyDerived : FamilyBase, FamilyMixin {
+    explicit FamilyDerived(int* destroyed) : destroyed(destroyed) {}
+    ~FamilyDerived() override { ++*destroyed; }
+    int* destroyed;
+    char payload[160] = {};
+};
+
+} // namespace
+
+TEST_F(MemoryPoolTest, BasicHashBucketConfig) {
+    // The table and the index math are compile-time constants
+    static_assert(WideFamily::kNumClasses == 18);
+    static_assert(WideFamily::Classes::index(100) == 6 && WideFamily::Classes::size(6) == 112);
+    static_assert(WideFamily::Classes::size(8) == 192 && WideFamily::Classes::size(17) == 4096);
+    static_assert(BasicHashBucket<>::kNumClasses == SizeClass::kNumClasses);
+    static_assert(MEMORY_POOL_NUM == 44 && SLOT_BASE_SIZE == 8 && MAX_SLOT_SIZE == 32768);
+    for (size_t size = 1; size <= WideFamily::kMaxSize; ++size) {
+        const size_t index = WideFamily::Classes::index(size);
+        ASSERT_LT(index, WideFamily::kNumClasses) << size;
+        ASSERT_GE(WideFamily::Classes::size(index), size) << size;
+        if (index > 0) {
+            ASSERT_LT(WideFamily::Classes::size(index - 1), size) << size;
+        }
+    }
+
+    MemoryPool& pool = WideFamily::pool<6>();
+    EXPECT_EQ(&pool, &WideFamily::pool(6));
+    EXPECT_EQ(pool.policy(), FreeListPolicy::PerBlock);
+    EXPECT_EQ(pool.nextBlockSize(), 8192u);
+
+    // Slots come from the family's pools, never from HashBucket's or another family's
+    void* p = WideFamily::useMemory(100);
+    ASSERT_NE(p, nullptr);
+    std::memset(p, 0x5A, 100);
+    ASSERT_NE(PageMap::get(p), nullptr);
+    EXPECT_EQ(PageMap::get(p)->owner, &pool);
+    void* q = BasicHashBucket<>::useMemory(100);
+    EXPECT_NE(PageMap::get(q)->owner, &HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(100))));
+    EXPECT_EQ(PageMap::get(q)->owner, &BasicHashBucket<>::pool(SizeClass::index(100)));
+    WideFamily::freeMemory(p, 100);
+    EXPECT_EQ(WideFamily::useMemory(112), p);
+    HashBucket::freeMemory(p);  // found through the PageMap
+    BasicHashBucket<>::freeMemory(q);
+
+    // Alignment, objects, and sizes above kMaxSize
+    void* aligned = WideFamily::useMemory(40, 64);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 64, 0u);
+    WideFamily::freeMemory(aligned, 40, 64);
+    auto* value = WideFamily::newElement<std::pair<int, double>>(7, 2.5);
+    EXPECT_EQ(value->first, 7);
+    WideFamily::deleteElement(value);
+
+    // Deleting through a base pointer returns the slot to the derived class's pool
+    int destroyed = 0;
+    FamilyDerived* derived = WideFamily::newElement<FamilyDerived>(&destroyed);
+    MemoryPool& derived_pool = WideFamily::pool(WideFamily::Classes::index(sizeof(FamilyDerived)));
+    ASSERT_NE(&derived_pool, &WideFamily::pool(WideFamily::Classes::index(sizeof(FamilyBase))));
+    EXPECT_EQ(PageMap::get(derived)->owner, &derived_pool);
+    FamilyBase* base = derived;
+    WideFamily::deleteElement(base);
+    EXPECT_EQ(destroyed, 1);
+    FamilyDerived* again = WideFamily::newElement<FamilyDerived>(&destroyed);
+    EXPECT_EQ(again, derived);
+    FamilyMixin* mixin = again;
+    ASSERT_NE(static_cast<void*>(mixin), static_cast<void*>(again));
+    WideFamily::deleteElement(mixin);
+    EXPECT_EQ(destroyed, 2);
+    EXPECT_EQ(WideFamily::newElement<FamilyDerived>(&destroyed), derived);
+    WideFamily::deleteElement(derived);
+    EXPECT_EQ(destroyed, 3);
+
+    for (size_t size : {size_t(5000), HashBucket::kMapThreshold}) {
+        void* large = WideFamily::useMemory(size);
+        std::memset(large, 0x5A, size);
+        WideFamily::freeMemory(large, size);
+    }
+
+#if ZP_ENABLE_STATS
+    EXPECT_GE(WideFamily::snapshotStats()[6].allocations, 2u);
+#endif
+    EXPECT_GT(WideFamily::trim(), 0u);
+}
+
+TEST_F(MemoryPoolTest, HashBucketMidSizeAllocation) {
+    // 1-8 KiB buffers are served by the pools now
+    for(size_t size : {1000, 1500, 4096, 5000, 8192, static_cast<int>(MAX_SLOT_SIZE)}) {
+        void* ptr = HashBucket::useMemory(size);
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0x5A, size);
+        HashBucket::freeMemory(ptr, size);
+        EXPECT_EQ(HashBucket::useMemory(size), ptr);
+        HashBucket::freeMemory(ptr, size);
+    }
 }
 
 TEST_F(MemoryPoolTest, HashBucketZeroSize) {
@@ -95,6 +311,66 @@ TEST_F(MemoryPoolTest, HashBucketZeroSize) {
     ASSERT_EQ(ptr, nullptr);
 }
 
+// Alignment-aware allocation tests
+struct alignas(64) CacheLineObject {
+    explicit CacheLineObject(int v) : value(v) {}
+    int value;
+};
+
+struct alignas(8192) PageSpanObject {
+    char bytes[16];
+};
+
+TEST_F(MemoryPoolTest, AlignedAllocation) {
+    // Every (size, align) pair gets a class that is big and aligned enough
+    for(size_t align = 1; align <= SizeClass::kMaxAlignment; align *= 2) {
+        for(size_t size = 1; size <= MAX_SLOT_SIZE; ++size) {
+            size_t index = SizeClass::index(size, align);
+            ASSERT_LT(index, static_cast<size_t>(MEMORY_POOL_NUM)) << size << '/' << align;
+            ASSERT_GE(SizeClass::size(index), size) << size << '/' << align;
+            ASSERT_GE(SizeClass::alignment(index), align) << size << '/' << align;
+        }
+    }
+    EXPECT_EQ(SizeClass::index(24, 8), SizeClass::index(24));
+    EXPECT_EQ(SizeClass::size(SizeClass::index(24, 64)), 64u);
+    EXPECT_EQ(SizeClass::index(16, 8192), static_cast<size_t>(MEMORY_POOL_NUM));
+
+    for(size_t align : {16, 32, 64, 128, 1024, 4096}) {
+        for(size_t size : {1, 24, 100, 3000, 5000}) {
+            void* ptr = HashBucket::useMemory(size, align);
+            ASSERT_NE(ptr, nullptr);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % align, 0u) << size << '/' << align;
+            EXPECT_NE(PageMap::get(ptr), nullptr);
+            std::memset(ptr, 0x5A, size);
+            HashBucket::freeMemory(ptr, size, align);
+        }
+    }
+    EXPECT_EQ(HashBucket::useMemory(0, 64), nullptr);
+
+    // newElement honors alignof(T)
+    std::vector<CacheLineObject*> objects;
+    for(int i = 0; i < 100; ++i) {
+        CacheLineObject* obj = newElement<CacheLineObject>(i);
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(obj) % alignof(CacheLineObject), 0u);
+        EXPECT_EQ(obj->value, i);
+        objects.push_back(obj);
+    }
+    for(CacheLineObject* obj : objects) {
+        deleteElement(obj);
+    }
+
+    // Beyond kMaxAlignment: falls back to the aligned operator new
+    PageSpanObject* span = newElement<PageSpanObject>();
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(span) % alignof(PageSpanObject), 0u);
+    EXPECT_EQ(PageMap::get(span), nullptr);
+    deleteElement(span);
+
+    PoolAllocator<CacheLineObject> alloc;
+    CacheLineObject* array = alloc.allocate(10);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(array) % alignof(CacheLineObject), 0u);
+    alloc.deallocate(array, 10);
+}
+
 // Test newElement and deleteElement
 struct TestObject {
     int value;
@@ -130,6 +406,422 @@ TEST_F(MemoryPoolTest, MultipleNewDeleteElements) {
     }
 }
 
+// Typed object pool tests
+struct Counted {
+    static int constructed;
+    static int destroyed;
+    explicit Counted(int v = 0) : value(v) { ++constructed; buffer.reserve(64); }
+    ~Counted() { ++destroyed; }
+    int value;
+    std::vector<int> buffer;
+    std::mutex mutex;
+};
+int Counted::constructed = 0;
+int Counted::destroyed = 0;
+
+struct ThrowingObject {
+    explicit ThrowingObject(bool fail) { if(fail) throw std::runtime_error("ctor"); }
+    char bytes[40];
+};
+
+TEST_F(MemoryPoolTest, ObjectPoolTyped) {
+    ObjectPool<TestObject> pool;
+    static_assert(ObjectPool<TestObject>::kSlotSize == sizeof(TestObject));
+    static_assert(ObjectPool<char>::kSlotSize == sizeof(Slot));
+
+    std::vector<TestObject*> objects;
+    for(int i = 0; i < 1000; ++i) {
+        TestObject* obj = pool.newElement(i, i * 0.5);
+        ASSERT_NE(obj, nullptr);
+        objects.push_back(obj);
+    }
+    for(int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(objects[i]->value, i);
+        EXPECT_DOUBLE_EQ(objects[i]->data, i * 0.5);
+    }
+    TestObject* last = objects.back();
+    for(TestObject* obj : objects) {
+        pool.deleteElement(obj);
+    }
+    EXPECT_EQ(pool.newElement(1, 2.0), last);
+    pool.deleteElement(last);
+    pool.deleteElement(nullptr);
+    // Released slots go straight back to the pool: nothing is cached, whole
+    // blocks can be trimmed right away
+    EXPECT_EQ(pool.cached(), 0u);
+    EXPECT_EQ(pool.clear(), 0u);
+#if ZP_ENABLE_STATS
+    EXPECT_EQ(pool.pool().stats().bytes_live, 0u);
+#endif
+    EXPECT_GT(pool.pool().Trim(), 0u);
+
+    // Slots are rounded up so that every free-list link is aligned
+    struct Odd { char c[12]; };
+    static_assert(ObjectPool<Odd>::kSlotSize == 16);
+    ObjectPool<Odd> odd;
+    std::vector<Odd*> odds;
+    for(int i = 0; i < 100; ++i) {
+        odds.push_back(odd.newElement());
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(odds.back()) % alignof(Slot), 0u);
+    }
+    for(Odd* o : odds) {
+        odd.deleteElement(o);
+    }
+    EXPECT_EQ(odd.newElement(), odds.back());
+    ObjectPool<Odd> odd_lock_free(FreeListPolicy::LockFree);
+    Odd* a = odd_lock_free.newElement();
+    Odd* b = odd_lock_free.newElement();
+    odd_lock_free.deleteElement(a);
+    odd_lock_free.deleteElement(b);
+    EXPECT_EQ(odd_lock_free.newElement(), b);
+    EXPECT_EQ(odd_lock_free.newElement(), a);
+
+    // A throwing constructor gives the slot back
+    ObjectPool<ThrowingObject> throwing;
+    ThrowingObject* ok = throwing.newElement(false);
+    throwing.deleteElement(ok);
+    EXPECT_THROW(throwing.newElement(true), std::runtime_error);
+    EXPECT_EQ(throwing.newElement(false), ok);
+    throwing.deleteElement(ok);
+
+    // Over-aligned types keep their alignment
+    ObjectPool<CacheLineObject> aligned;
+    CacheLineObject* line = aligned.newElement(3);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(line) % alignof(CacheLineObject), 0u);
+    aligned.deleteElement(line);
+}
+
+TEST_F(MemoryPoolTest, ObjectPoolKeepConstructed) {
+    Counted::constructed = Counted::destroyed = 0;
+    {
+        ObjectPool<Counted, 4096, ObjectReuse::KeepConstructed> pool;
+        Counted* a = pool.newElement(1);
+        Counted* b = pool.newElement(2);
+        a->buffer.push_back(7);
+        pool.deleteElement(a);
+        EXPECT_EQ(pool.cached(), 1u);
+        EXPECT_EQ(Counted::destroyed, 0);
+
+        // The parked object comes back untouched, without a constructor call
+        Counted* again = pool.newElement(99);
+        EXPECT_EQ(again, a);
+        EXPECT_EQ(again->value, 1);
+        ASSERT_EQ(again->buffer.size(), 1u);
+        EXPECT_EQ(again->buffer[0], 7);
+        EXPECT_GE(again->buffer.capacity(), 64u);
+        EXPECT_EQ(Counted::constructed, 2);
+
+        pool.deleteElement(again);
+        pool.deleteElement(b);
+        EXPECT_EQ(pool.clear(), 2u);
+        EXPECT_EQ(Counted::destroyed, 2);
+        EXPECT_EQ(pool.cached(), 0u);
+
+        // Parked objects are destroyed with the pool
+        pool.deleteElement(pool.newElement(3));
+    }
+    EXPECT_EQ(Counted::constructed, 3);
+    EXPECT_EQ(Counted::destroyed, 3);
+}
+
+// Arena tests
+TEST_F(MemoryPoolTest, ArenaBumpAllocation) {
+    Arena arena(1000);
+    EXPECT_EQ(arena.chunkSize(), SizeClass::size(SizeClass::index(1000)));
+    EXPECT_EQ(arena.bytesHeld(), 0u);
+
+    // Mixed sizes and alignments come from the same chunk, in order
+    char* a = static_cast<char*>(arena.allocate(3, 1));
+    char* b = static_cast<char*>(arena.allocate(5, 1));
+    EXPECT_EQ(b, a + 3);
+    void* c = arena.allocate(24, 64);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(c) % 64, 0u);
+    TestObject* obj = arena.create<TestObject>(1, 2.5);
+    EXPECT_EQ(obj->value, 1);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(obj) % alignof(TestObject), 0u);
+    EXPECT_EQ(arena.bytesHeld(), arena.chunkSize());
+
+    // The chunk is a slot of the matching HashBucket pool
+    EXPECT_EQ(PageMap::get(a)->owner, &HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(arena.chunkSize()))));
+
+    // Running out of room starts a new chunk
+    for(int i = 0; i < 100; ++i) {
+        std::memset(arena.allocate(64), i, 64);
+    }
+    EXPECT_GT(arena.bytesHeld(), arena.chunkSize());
+    EXPECT_EQ(arena.bytesHeld() % arena.chunkSize(), 0u);
+
+    // Requests larger than a chunk get their own allocation
+    void* big = arena.allocate(100000, 16);
+    std::memset(big, 0xAB, 100000);
+    void* over = arena.allocate(10, 8192);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(over) % 8192, 0u);
+    EXPECT_GT(arena.bytesHeld(), 100000u);
+
+    // release() hands everything back; the chunk is reused by the next arena
+    arena.release();
+    EXPECT_EQ(arena.bytesHeld(), 0u);
+    Arena next(1000);
+    EXPECT_EQ(next.allocate(3, 1), a);
+}
+
+TEST_F(MemoryPoolTest, ArenaScopeRewind) {
+    Arena arena(512);
+    void* base = arena.allocate(16);
+    const size_t held = arena.bytesHeld();
+    void* inner = nullptr;
+    {
+        ArenaScope outer(arena);
+        inner = arena.allocate(32);
+        {
+            ArenaScope nested(arena);
+            for(int i = 0; i < 50; ++i) {
+                arena.allocate(48);
+            }
+            arena.allocate(4096);
+            EXPECT_GT(arena.bytesHeld(), held);
+        }
+        // The nested scope released only its own allocations
+        void* after = arena.allocate(32);
+        EXPECT_EQ(after, static_cast<char*>(inner) + 32);
+    }
+    EXPECT_EQ(arena.bytesHeld(), held);
+
+    // Rewinding to the start of a scope reuses the same memory
+    EXPECT_EQ(arena.allocate(32), inner);
+
+    Arena::Marker marker = arena.mark();
+    arena.allocate(400);
+    arena.rewind(marker);
+    EXPECT_EQ(arena.allocate(32), static_cast<char*>(inner) + 32);
+    EXPECT_NE(base, nullptr);
+}
+
+// STL allocator tests
+TEST_F(MemoryPoolTest, PoolAllocatorContainers) {
+    std::list<int, PoolAllocator<int>> list;
+    std::map<int, std::string, std::less<int>, PoolAllocator<std::pair<const int, std::string>>> map;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int>>> hash;
+    std::vector<double, PoolAllocator<double>> vec;
+    for(int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+        map.emplace(i, std::to_string(i));
+        hash[i] = i * 2;
+        vec.push_back(i * 0.5);
+    }
+    EXPECT_EQ(list.size(), 1000u);
+    EXPECT_EQ(map.at(500), "500");
+    EXPECT_EQ(hash.at(999), 1998);
+    EXPECT_DOUBLE_EQ(vec[10], 5.0);
+    for(int i = 0; i < 1000; i += 2) {
+        map.erase(i);
+        hash.erase(i);
+    }
+    EXPECT_EQ(map.size(), 500u);
+
+    // Single-object requests come from the pool of sizeof(T)
+    struct Node { char bytes[72]; };
+    PoolAllocator<Node> alloc;
+    Node* node = alloc.allocate(1);
+    EXPECT_EQ(PageMap::get(node)->owner, &HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(sizeof(Node)))));
+    alloc.deallocate(node, 1);
+    EXPECT_TRUE(alloc == PoolAllocator<int>());
+    EXPECT_THROW(alloc.allocate(std::numeric_limits<size_t>::max() / 2), std::bad_array_new_length);
+}
+
+TEST_F(MemoryPoolTest, PoolMemoryResource) {
+    std::pmr::memory_resource* resource = poolMemoryResource();
+    EXPECT_TRUE(resource->is_equal(*poolMemoryResource()));
+    EXPECT_FALSE(resource->is_equal(*std::pmr::new_delete_resource()));
+
+    std::pmr::vector<std::pmr::string> strings(resource);
+    std::pmr::map<int, int> map(resource);
+    for(int i = 0; i < 500; ++i) {
+        strings.emplace_back(std::string(i % 100, 'x'));
+        map[i] = i;
+    }
+    EXPECT_EQ(strings[99].size(), 99u);
+    EXPECT_EQ(map.size(), 500u);
+
+    // Over-aligned requests move up to an aligned enough class, oversized ones go to operator new
+    void* aligned = resource->allocate(48, 256);
+    EXPECT_NE(PageMap::get(aligned), nullptr);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 256, 0u);
+    resource->deallocate(aligned, 48, 256);
+    void* big = resource->allocate(MAX_SLOT_SIZE + 1);
+    resource->deallocate(big, MAX_SLOT_SIZE + 1);
+
+    // Naturally aligned requests are pooled
+    void* pooled = resource->allocate(64, 64);
+    EXPECT_NE(PageMap::get(pooled), nullptr);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pooled) % 64, 0u);
+    resource->deallocate(pooled, 64, 64);
+}
+
+// Size-free deallocation tests
+TEST_F(MemoryPoolTest, SizeFreeDeallocation) {
+    void* small = HashBucket::useMemory(100);
+    HashBucket::freeMemory(small);
+    EXPECT_EQ(HashBucket::useMemory(100), small);
+    HashBucket::freeMemory(small);
+
+    // Not in any pool block: goes to operator delete
+    void* large = HashBucket::useMemory(MAX_SLOT_SIZE * 2);
+    EXPECT_EQ(PageMap::get(large), nullptr);
+    HashBucket::freeMemory(large);
+    HashBucket::freeMemory(nullptr);
+
+    // tryFreeMemory() leaves foreign memory alone
+    int on_stack = 0;
+    EXPECT_FALSE(HashBucket::tryFreeMemory(&on_stack));
+    void* pooled = HashBucket::useMemory(24);
+    EXPECT_TRUE(HashBucket::tryFreeMemory(pooled));
+
+    // Slots of a standalone pool go back to that pool
+    MemoryPool pool(4096);
+    pool.init(112);
+    void* slot = pool.Allocate();
+    HashBucket::freeMemory(slot);
+    EXPECT_EQ(pool.Allocate(), slot);
+    pool.Deallocate(slot);
+}
+
+namespace {
+
+struct Shape {
+    virtual ~Shape() = default;
+    int id = 0;
+};
+
+struct Tagged {
+    virtual ~Tagged() = default;
+    long tag = 7;
+};
+
+// Much larger than Shape and with Tagged as a second base at a non-zero offset
+struct Polygon : Shape, Tagged {
+    explicit Polygon(int* destroyed) : destroyed(destroyed) {}
+    ~Polygon() override { ++*destroyed; }
+    int* destroyed;
+    double points[32] = {};
+};
+
+// Too aligned for any size class: comes from the aligned operator new
+struct alignas(8192) PageAlignedShape {
+    virtual ~PageAlignedShape() = default;
+};
+
+struct PageAlignedPolygon : PageAlignedShape {
+    explicit PageAlignedPolygon(int* destroyed) : destroyed(destroyed) {}
+    ~PageAlignedPolygon() override { ++*destroyed; }
+    int* destroyed;
+};
+
+} // namespace
+
+TEST_F(MemoryPoolTest, PolymorphicDeleteElement) {
+    int destroyed = 0;
+    Polygon* polygon = newElement<Polygon>(&destroyed);
+    Shape* shape = polygon;
+    deleteElement(shape);
+    EXPECT_EQ(destroyed, 1);
+    // The slot went back to the Polygon size class, not the Shape one
+    Polygon* again = newElement<Polygon>(&destroyed);
+    EXPECT_EQ(again, polygon);
+
+    Tagged* tagged = again;
+    ASSERT_NE(static_cast<void*>(tagged), static_cast<void*>(again));
+    deleteElement(tagged);
+    EXPECT_EQ(destroyed, 2);
+    EXPECT_EQ(newElement<Polygon>(&destroyed), polygon);
+    deleteElement(polygon);
+
+    // Over-aligned objects are released with their alignment, not through a pool
+    PageAlignedPolygon* aligned = newElement<PageAlignedPolygon>(&destroyed);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 8192, 0u);
+    EXPECT_EQ(PageMap::get(aligned), nullptr);
+    PageAlignedShape* base = aligned;
+    deleteElement(base);
+    EXPECT_EQ(destroyed, 4);
+}
+
+// Hardening tests
+TEST_F(MemoryPoolTest, HardenedFreeChecks) {
+#if !ZP_HARDENED
+    GTEST_SKIP() << "built without ZP_HARDENED";
+#else
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+
+    // Free-list links are stored encoded
+    void* a = HashBucket::useMemory(64);
+    void* b = HashBucket::useMemory(64);
+    HashBucket::freeMemory(a, 64);
+    HashBucket::freeMemory(b, 64);
+    EXPECT_NE(static_cast<void*>(static_cast<Slot*>(b)->next), a);
+    EXPECT_EQ(static_cast<Slot*>(b)->getNext(), a);
+    EXPECT_EQ(HashBucket::useMemory(64), b);
+    EXPECT_EQ(HashBucket::useMemory(64), a);
+
+    // A slot that was freed and handed out again is a normal slot
+    HashBucket::freeMemory(a, 64);
+    void* again = HashBucket::useMemory(64);
+    HashBucket::freeMemory(again, 64);
+    HashBucket::freeMemory(b, 64);
+
+    int on_stack = 0;
+    EXPECT_DEATH({
+        void* p = HashBucket::useMemory(64);
+        HashBucket::freeMemory(p, 64);
+        HashBucket::freeMemory(p, 64);
+    }, "double free");
+    EXPECT_DEATH(HashBucket::freeMemory(static_cast<char*>(HashBucket::useMemory(64)) + 8, 64),
+                 "does not start a slot");
+    EXPECT_DEATH(HashBucket::freeMemory(HashBucket::useMemory(64), 128), "wrong size");
+    EXPECT_DEATH(HashBucket::freeMemory(&on_stack, 64), "not in any pool block");
+    EXPECT_DEATH({
+        char* p = static_cast<char*>(HashBucket::useMemory(64));
+        HashBucket::freeMemory(p, 64);
+        p[40] = 1;
+        HashBucket::useMemory(64);
+    }, "overwritten|use-after-poison");
+    EXPECT_DEATH({
+        MemoryPool pool(4096);
+        pool.init(32);
+        Slot* p = static_cast<Slot*>(pool.Allocate());
+        pool.Allocate();
+        pool.Deallocate(p);
+        std::memset(&p->next, 0, sizeof(p->next));
+        pool.Allocate();
+    }, "corrupted free list");
+
+    MemoryPool other(4096);
+    other.init(64);
+    EXPECT_DEATH(other.Deallocate(HashBucket::useMemory(64)), "wrong pool");
+#endif
+}
+
+TEST_F(MemoryPoolTest, AsanPoisonsFreeSlots) {
+#if !ZP_ASAN
+    GTEST_SKIP() << "built without AddressSanitizer";
+#else
+    char* p = static_cast<char*>(HashBucket::useMemory(256));
+    EXPECT_FALSE(__asan_address_is_poisoned(p + 100));
+    HashBucket::freeMemory(p, 256);
+    EXPECT_TRUE(__asan_address_is_poisoned(p + 100));
+    EXPECT_TRUE(__asan_address_is_poisoned(p + 255));
+    EXPECT_EQ(HashBucket::useMemory(256), p);
+    EXPECT_FALSE(__asan_address_is_poisoned(p + 100));
+
+    MemoryPool pool(4096);
+    pool.init(128);
+    char* q = static_cast<char*>(pool.Allocate());
+    pool.Deallocate(q);
+    EXPECT_TRUE(__asan_address_is_poisoned(q + 64));
+    EXPECT_FALSE(__asan_address_is_poisoned(q));
+    HashBucket::freeMemory(p, 256);
+#endif
+}
+
 // Thread safety tests
 TEST_F(MemoryPoolTest, ConcurrentAllocation) {
     MemoryPool pool(8192);
@@ -201,43 +893,1136 @@ TEST_F(MemoryPoolTest, ConcurrentHashBucket) {
     EXPECT_EQ(success_count.load(), num_threads * allocations_per_thread);
 }
 
-// Performance test
-TEST_F(MemoryPoolTest, PerformanceComparison) {
-    const int num_allocations = 10000;
-    
-    // Test memory pool performance
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    std::vector<void*> pool_ptrs;
-    for(int i = 0; i < num_allocations; ++i) {
+TEST_F(MemoryPoolTest, LockFreePolicyReusesFreedSlot) {
+    MemoryPool pool(4096);
+    pool.init(64, FreeListPolicy::LockFree);
+    EXPECT_EQ(pool.policy(), FreeListPolicy::LockFree);
+
+    void* ptr1 = pool.Allocate();
+    void* ptr2 = pool.Allocate();
+    ASSERT_NE(ptr1, nullptr);
+    ASSERT_NE(ptr2, nullptr);
+    EXPECT_NE(ptr1, ptr2);
+
+    pool.Deallocate(ptr1);
+    pool.Deallocate(ptr2);
+    // Treiber stack is LIFO
+    EXPECT_EQ(pool.Allocate(), ptr2);
+    EXPECT_EQ(pool.Allocate(), ptr1);
+    pool.Deallocate(ptr1);
+    pool.Deallocate(ptr2);
+}
+
+TEST_F(MemoryPoolTest, ConcurrentLockFreeAllocation) {
+    MemoryPool pool(8192);
+    pool.init(32, FreeListPolicy::LockFree);
+
+    const int num_threads = 4;
+    const int rounds = 200;
+    const int allocations_per_round = 32;
+    std::vector<std::thread> threads;
+    std::atomic<int> corrupted(0);
+
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&pool, &corrupted, t]() {
+            std::vector<void*> local_ptrs;
+            for(int r = 0; r < rounds; ++r) {
+                for(int i = 0; i < allocations_per_round; ++i) {
+                    void* ptr = pool.Allocate();
+                    // Tag the slot; another thread holding it would overwrite this
+                    static_cast<int*>(ptr)[2] = t;
+                    local_ptrs.push_back(ptr);
+                }
+                for(void* ptr : local_ptrs) {
+                    if(static_cast<int*>(ptr)[2] != t) {
+                        corrupted++;
+                    }
+                    pool.Deallocate(ptr);
+                }
+                local_ptrs.clear();
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(corrupted.load(), 0);
+}
+
+// Initialization tests
+TEST_F(MemoryPoolTest, ReadyPoolWithoutInit) {
+    MemoryPool pool(64, BlockSizePolicy{});
+    void* ptr = pool.Allocate();
+    ASSERT_NE(ptr, nullptr);
+    std::memset(ptr, 0, 64);
+    pool.Deallocate(ptr);
+    EXPECT_EQ(pool.Allocate(), ptr);
+    pool.Deallocate(ptr);
+}
+
+TEST_F(MemoryPoolTest, ReinitKeepsWarmMemory) {
+    MemoryPool pool(4096);
+    pool.init(32);
+
+    void* ptr1 = pool.Allocate();
+    void* ptr2 = pool.Allocate();
+    pool.Deallocate(ptr1);
+
+    // A second init must neither leak the block nor forget the free slot
+    pool.init(32);
+    EXPECT_EQ(pool.Allocate(), ptr1);
+
+    // Switching the policy moves the free slots over
+    pool.Deallocate(ptr2);
+    pool.init(32, FreeListPolicy::LockFree);
+    EXPECT_EQ(pool.policy(), FreeListPolicy::LockFree);
+    EXPECT_EQ(pool.Allocate(), ptr2);
+
+    pool.Deallocate(ptr1);
+    pool.Deallocate(ptr2);
+    pool.init(32, FreeListPolicy::Locked);
+    void* a = pool.Allocate();
+    void* b = pool.Allocate();
+    EXPECT_TRUE((a == ptr1 && b == ptr2) || (a == ptr2 && b == ptr1));
+    pool.Deallocate(a);
+    pool.Deallocate(b);
+}
+
+TEST_F(MemoryPoolTest, HashBucketReinitKeepsSlots) {
+    void* ptr = HashBucket::useMemory(128);
+    ASSERT_NE(ptr, nullptr);
+    *static_cast<int*>(ptr) = 7;
+
+    HashBucket::initMemoryPool();
+    // Memory handed out before re-initialization stays valid
+    EXPECT_EQ(*static_cast<int*>(ptr), 7);
+    HashBucket::freeMemory(ptr, 128);
+}
+
+// Block growth tests
+TEST_F(MemoryPoolTest, BlockSizeGrowsGeometrically) {
+    MemoryPool pool(4096, 32768);
+    pool.init(512);
+    EXPECT_EQ(pool.nextBlockSize(), 4096u);
+
+    std::vector<void*> ptrs;
+    size_t expected = 4096;
+    while(expected < 32768) {
+        // Allocate until the pool opens its next block
+        while(pool.nextBlockSize() == expected) {
+            ptrs.push_back(pool.Allocate());
+        }
+        expected *= 2;
+        EXPECT_EQ(pool.nextBlockSize(), expected);
+    }
+    EXPECT_EQ(pool.nextBlockSize(), 32768u);
+
+    for(void* ptr : ptrs) {
+        pool.Deallocate(ptr);
+    }
+}
+
+TEST_F(MemoryPoolTest, FixedBlockSizeByDefault) {
+    MemoryPool pool(4096);
+    pool.init(64);
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 500; ++i) {
+        ptrs.push_back(pool.Allocate());
+    }
+    EXPECT_EQ(pool.nextBlockSize(), 4096u);
+    for(void* ptr : ptrs) {
+        pool.Deallocate(ptr);
+    }
+}
+
+TEST_F(MemoryPoolTest, BlockSmallerThanSlot) {
+    MemoryPool pool(64);
+    pool.init(256);
+    void* ptr1 = pool.Allocate();
+    void* ptr2 = pool.Allocate();
+    ASSERT_NE(ptr1, nullptr);
+    ASSERT_NE(ptr2, nullptr);
+    EXPECT_NE(ptr1, ptr2);
+    // Both slots must be fully usable
+    std::memset(ptr1, 0xAB, 256);
+    std::memset(ptr2, 0xCD, 256);
+    EXPECT_EQ(static_cast<unsigned char*>(ptr1)[255], 0xAB);
+    pool.Deallocate(ptr1);
+    pool.Deallocate(ptr2);
+}
+
+// Trim tests
+TEST_F(MemoryPoolTest, TrimReleasesIdleBlocks) {
+    MemoryPool pool(4096);
+    pool.init(64);
+
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 300; ++i) {
+        ptrs.push_back(pool.Allocate());
+    }
+    // Nothing can be released while every slot is live
+    EXPECT_EQ(pool.Trim(), 0u);
+
+    for(void* ptr : ptrs) {
+        pool.Deallocate(ptr);
+    }
+    EXPECT_GE(pool.Trim(), 300u * 64);
+    EXPECT_EQ(pool.Trim(), 0u);
+
+    // The pool keeps working after giving everything back
+    void* ptr = pool.Allocate();
+    ASSERT_NE(ptr, nullptr);
+    std::memset(ptr, 0, 64);
+    pool.Deallocate(ptr);
+}
+
+TEST_F(MemoryPoolTest, TrimKeepsBlocksWithLiveSlots) {
+    MemoryPool pool(4096);
+    pool.init(64);
+
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 300; ++i) {
+        ptrs.push_back(pool.Allocate());
+    }
+    // Keep the very first slot alive, free the rest
+    void* survivor = ptrs.front();
+    *static_cast<int*>(survivor) = 1234;
+    for(size_t i = 1; i < ptrs.size(); ++i) {
+        pool.Deallocate(ptrs[i]);
+    }
+
+    size_t released = pool.Trim();
+    EXPECT_GT(released, 0u);
+    EXPECT_EQ(*static_cast<int*>(survivor), 1234);
+
+    // Remaining free slots are all still allocatable and distinct from the survivor
+    std::set<void*> seen;
+    for(int i = 0; i < 300; ++i) {
+        void* ptr = pool.Allocate();
+        EXPECT_NE(ptr, survivor);
+        EXPECT_TRUE(seen.insert(ptr).second);
+    }
+    for(void* ptr : seen) {
+        pool.Deallocate(ptr);
+    }
+    pool.Deallocate(survivor);
+    EXPECT_GT(pool.Trim(), 0u);
+}
+
+TEST_F(MemoryPoolTest, PerBlockPolicyPrefersFullestBlock) {
+    MemoryPool pool(4096);
+    pool.init(64, FreeListPolicy::PerBlock);
+    EXPECT_EQ(pool.policy(), FreeListPolicy::PerBlock);
+
+    // Fill three whole blocks (the first slot of a fourth one stays live)
+    // and group the slots by block
+    std::map<BlockHeader*, std::vector<void*>> by_block;
+    void* last = nullptr;
+    while(by_block.size() < 4) {
+        last = pool.Allocate();
+        by_block[PageMap::get(last)].push_back(last);
+    }
+    std::vector<std::vector<void*>*> blocks;
+    for(auto& [block, slots] : by_block) {
+        if(block != PageMap::get(last)) {
+            blocks.push_back(&slots);
+        }
+    }
+    ASSERT_EQ(blocks.size(), 3u);
+    std::vector<void*>& nearly_full = *blocks[0];
+    std::vector<void*>& half = *blocks[1];
+    std::vector<void*>& empty = *blocks[2];
+
+    // Free one slot of the first block, half of the second and all of the
+    // third, the emptiest last: a LIFO list would hand those out first
+    pool.Deallocate(nearly_full.back());
+    for(size_t i = 0; i < half.size() / 2; ++i) {
+        pool.Deallocate(half[i]);
+    }
+    for(void* ptr : empty) {
+        pool.Deallocate(ptr);
+    }
+
+    // Allocations refill the fullest blocks first and stay within a block
+    EXPECT_EQ(pool.Allocate(), nearly_full.back());
+    std::set<void*> refilled(half.begin(), half.begin() + half.size() / 2);
+    for(size_t i = 0; i < half.size() / 2; ++i) {
+        EXPECT_EQ(refilled.count(pool.Allocate()), 1u) << i;
+    }
+
+    // The untouched block is released without walking a free list
+    const size_t block_bytes = PageMap::get(empty.front())->size;
+    EXPECT_EQ(pool.Trim(), block_bytes);
+    EXPECT_EQ(pool.fragmentation().slots_free, 0u);
+
+    // Switching the policy keeps every free slot
+    for(size_t i = 0; i < half.size() / 2; ++i) {
+        pool.Deallocate(half[i]);
+    }
+    pool.init(64, FreeListPolicy::Locked);
+    pool.init(64, FreeListPolicy::PerBlock);
+    EXPECT_EQ(pool.fragmentation().slots_free, half.size() / 2);
+    for(size_t i = 0; i < half.size() / 2; ++i) {
+        EXPECT_EQ(refilled.count(pool.Allocate()), 1u) << i;
+    }
+    pool.Deallocate(last);
+}
+
+TEST_F(MemoryPoolTest, HashBucketTrimAll) {
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 2000; ++i) {
+        ptrs.push_back(HashBucket::useMemory(4096));
+    }
+    for(void* ptr : ptrs) {
+        HashBucket::freeMemory(ptr, 4096);
+    }
+    EXPECT_GT(HashBucket::trimAll(), 0u);
+
+    void* ptr = HashBucket::useMemory(4096);
+    ASSERT_NE(ptr, nullptr);
+    HashBucket::freeMemory(ptr, 4096);
+
+    HashBucket::startBackgroundTrim(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    HashBucket::stopBackgroundTrim();
+}
+
+// Layout tests
+TEST_F(MemoryPoolTest, PoolCacheLineLayout) {
+    EXPECT_EQ(alignof(MemoryPool) % CACHE_LINE_SIZE, 0u);
+    EXPECT_EQ(sizeof(MemoryPool) % CACHE_LINE_SIZE, 0u);
+
+    // Neighbouring pools of the static table never share a cache line
+    for(int i = 0; i < MEMORY_POOL_NUM; ++i) {
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&HashBucket::getMemoryPool(i)) % CACHE_LINE_SIZE, 0u) << i;
+    }
+    MemoryPool* pools = new MemoryPool[2];
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&pools[1]) % CACHE_LINE_SIZE, 0u);
+    delete[] pools;
+}
+
+// Block provider tests
+namespace {
+
+// Counts the blocks going through the default provider
+struct CountingBlockProvider : BlockProvider {
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> released{0};
+
+    void* allocate(size_t bytes) override {
+        EXPECT_EQ(bytes % PageMap::kPageSize, 0u);
+        ++allocated;
+        return BlockProvider::defaultProvider().allocate(bytes);
+    }
+    void deallocate(void* block, size_t bytes) override {
+        ++released;
+        BlockProvider::defaultProvider().deallocate(block, bytes);
+    }
+};
+
+} // namespace
+
+TEST_F(MemoryPoolTest, CustomBlockProvider) {
+    CountingBlockProvider provider;
+    {
+        MemoryPool pool(4096);
+        pool.init(64);
+        void* before = pool.Allocate();  // block from the default provider
+
+        pool.setBlockProvider(&provider);
+        EXPECT_EQ(&pool.blockProvider(), &provider);
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 200; ++i) {
+            ptrs.push_back(pool.Allocate());
+        }
+        EXPECT_GT(provider.allocated.load(), 0u);
+
+        for(void* ptr : ptrs) {
+            pool.Deallocate(ptr);
+        }
+        pool.Deallocate(before);
+        pool.Trim();
+        // Every block went back to the provider it came from
+        EXPECT_EQ(provider.released.load(), provider.allocated.load());
+    }
+    EXPECT_EQ(provider.released.load(), provider.allocated.load());
+}
+
+TEST_F(MemoryPoolTest, HugePageBlockProvider) {
+    HugePageBlockProvider provider;
+    {
+        MemoryPool pool(64 * 1024, 512 * 1024);
+        pool.init(256);
+        pool.setBlockProvider(&provider);
+
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 20000; ++i) {
+            void* ptr = pool.Allocate();
+            ASSERT_NE(ptr, nullptr);
+            std::memset(ptr, i & 0xff, 256);
+            ptrs.push_back(ptr);
+        }
+        // 20000 * 256 bytes need a few 2 MiB regions
+        EXPECT_GE(provider.regions(), 2u);
+
+        for(void* ptr : ptrs) {
+            pool.Deallocate(ptr);
+        }
+        EXPECT_GT(pool.Trim(), 0u);
+
+        // Released blocks are reused before new regions are mapped
+        size_t regions = provider.regions();
+        for(int i = 0; i < 1000; ++i) {
+            ptrs[i] = pool.Allocate();
+            std::memset(ptrs[i], 0, 256);
+        }
+        EXPECT_EQ(provider.regions(), regions);
+        for(int i = 0; i < 1000; ++i) {
+            pool.Deallocate(ptrs[i]);
+        }
+    }
+    // A block larger than a region gets its own mapping
+    void* big = provider.allocate(HugePageBlockProvider::kRegionSize * 2);
+    std::memset(big, 1, HugePageBlockProvider::kRegionSize * 2);
+    provider.deallocate(big, HugePageBlockProvider::kRegionSize * 2);
+}
+
+// NUMA tests
+TEST_F(MemoryPoolTest, NumaNodePools) {
+    ASSERT_GE(HashBucket::numaNodes(), 1);
+    ASSERT_LE(HashBucket::numaNodes(), MAX_NUMA_NODES);
+    int node = HashBucket::currentNumaNode();
+    ASSERT_GE(node, 0);
+    ASSERT_LT(node, HashBucket::numaNodes());
+    EXPECT_EQ(&HashBucket::getMemoryPool(3), &HashBucket::getMemoryPool(3, node));
+    EXPECT_THROW(HashBucket::getMemoryPool(3, HashBucket::numaNodes()), std::out_of_range);
+
+    // Memory handed out by useMemory() belongs to a pool of some node
+    void* ptr = HashBucket::useMemory(100);
+    MemoryPool* owner = PageMap::get(ptr)->owner;
+    bool found = false;
+    for(int n = 0; n < HashBucket::numaNodes(); ++n) {
+        found |= owner == &HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(100)), n);
+    }
+    EXPECT_TRUE(found);
+    HashBucket::freeMemory(ptr, 100);
+
+    // The node-local provider places blocks on the requested node
+    NumaBlockProvider provider(node);
+    EXPECT_EQ(provider.node(), node);
+    void* block = provider.allocate(PageMap::kPageSize * 4);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(block) % PageMap::kPageSize, 0u);
+    std::memset(block, 0, PageMap::kPageSize * 4);
+    provider.deallocate(block, PageMap::kPageSize * 4);
+}
+
+TEST_F(MemoryPoolTest, ShardedPools) {
+    EXPECT_EQ(HashBucket::poolShards(), ZP_POOL_SHARDS);
+    const int node = HashBucket::currentNumaNode();
+    const int shard = HashBucket::currentShard();
+    ASSERT_GE(shard, 0);
+    ASSERT_LT(shard, HashBucket::poolShards());
+    EXPECT_EQ(&HashBucket::getMemoryPool(5), &HashBucket::getMemoryPool(5, node, shard));
+    EXPECT_THROW(HashBucket::getMemoryPool(5, node, HashBucket::poolShards()), std::out_of_range);
+
+    // Threads are spread round-robin over the shards
+    auto shardOfNewThread = [] {
+        int result = -1;
+        std::thread([&result] { result = HashBucket::currentShard(); }).join();
+        return result;
+    };
+    std::set<int> seen;
+    for(int i = 0; i < HashBucket::poolShards(); ++i) {
+        seen.insert(shardOfNewThread());
+    }
+    EXPECT_EQ(seen.size(), static_cast<size_t>(HashBucket::poolShards()));
+    if(HashBucket::poolShards() == 1) {
+        return;
+    }
+#if ZP_PER_CPU_CACHE
+    if(CpuCache::currentCpu() >= 0) {
+        return; // per-CPU caches refill from the CPU's shard, not the thread's
+    }
+#endif
+
+    // A thread whose shard holds nothing takes free slots of a sibling shard
+    // instead of growing its own, and gives them back to their owner
+    constexpr size_t kSize = 9000;
+    const int index = static_cast<int>(SizeClass::index(kSize));
+    int donor = -1;
+    std::thread([&donor] {
+        donor = HashBucket::currentShard();
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 8; ++i) {
+            ptrs.push_back(HashBucket::useMemory(kSize));
+        }
+        for(void* p : ptrs) {
+            HashBucket::freeMemory(p, kSize);
+        }
+    }).join();
+    MemoryPool& donor_pool = HashBucket::getMemoryPool(index, node, donor);
+    EXPECT_EQ(donor_pool.fragmentation().slots_live, 0u);
+
+    std::thread([&] {
+        const int thief = HashBucket::currentShard();
+        ASSERT_NE(thief, donor);
+        MemoryPool& own = HashBucket::getMemoryPool(index, node, thief);
+        ASSERT_EQ(own.stats().bytes_reserved, 0u) << "size class already used on this shard";
+        void* p = HashBucket::useMemory(kSize);
+        EXPECT_EQ(PageMap::get(p)->owner, &donor_pool);
+        EXPECT_EQ(own.stats().bytes_reserved, 0u);
+        HashBucket::freeMemory(p, kSize);
+    }).join();
+    // Back on the donor's free list once the thief's cache was flushed at exit
+    FragmentationStats st = donor_pool.fragmentation();
+    EXPECT_EQ(st.slots_live, 0u);
+    EXPECT_GE(st.slots_free, 8u);
+}
+
+// Statistics tests
+TEST_F(MemoryPoolTest, PoolStatsCounters) {
+    MemoryPool pool(4096);
+    pool.init(64);
+
+    std::vector<void*> ptrs(100, nullptr);
+    pool.AllocateBatch(ptrs.data(), 50);
+    for(size_t i = 50; i < ptrs.size(); ++i) {
+        ptrs[i] = pool.Allocate();
+    }
+    PoolStats st = pool.stats();
+    EXPECT_EQ(st.slot_size, 64u);
+    EXPECT_GT(st.bytes_reserved, 0u);
+#if ZP_ENABLE_STATS
+    EXPECT_EQ(st.allocations, 100u);
+    EXPECT_EQ(st.frees, 0u);
+    EXPECT_EQ(st.bytes_live, 100u * 64);
+    EXPECT_GE(st.blocks_allocated, 2u);
+    EXPECT_EQ(st.free_list_length, 0u);
+#endif
+
+    pool.DeallocateBatch(ptrs.data(), 60);
+    for(size_t i = 60; i < ptrs.size(); ++i) {
+        pool.Deallocate(ptrs[i]);
+    }
+    st = pool.stats();
+#if ZP_ENABLE_STATS
+    EXPECT_EQ(st.frees, 100u);
+    EXPECT_EQ(st.bytes_live, 0u);
+    EXPECT_EQ(st.free_list_length, 100u);
+    EXPECT_EQ(st.free_list_high_water, 100u);
+#endif
+
+    pool.Trim();
+    st = pool.stats();
+    EXPECT_EQ(st.bytes_reserved, 0u);
+#if ZP_ENABLE_STATS
+    EXPECT_EQ(st.free_list_length, 0u);
+    EXPECT_EQ(st.free_list_high_water, 100u);
+#endif
+}
+
+TEST_F(MemoryPoolTest, HashBucketSnapshotStats) {
+    void* ptr = HashBucket::useMemory(200);
+    auto stats = HashBucket::snapshotStats();
+    ASSERT_EQ(stats.size(), static_cast<size_t>(MEMORY_POOL_NUM));
+    const PoolStats& st = stats[SizeClass::index(200)];
+    EXPECT_EQ(st.slot_size, SizeClass::size(SizeClass::index(200)));
+    EXPECT_GT(st.bytes_reserved, 0u);
+#if ZP_ENABLE_STATS
+    EXPECT_GT(st.allocations, 0u);
+#endif
+    HashBucket::freeMemory(ptr, 200);
+
+    std::ostringstream os;
+    HashBucket::dumpStats(os);
+    EXPECT_NE(os.str().find("slot_size"), std::string::npos);
+}
+
+TEST_F(MemoryPoolTest, FragmentationReport) {
+    // Every byte and every slot of a standalone pool is accounted for
+    MemoryPool pool(4096);
+    pool.init(72);
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 100; ++i) {
+        ptrs.push_back(pool.Allocate());
+    }
+    for(int i = 0; i < 30; ++i) {
+        pool.Deallocate(ptrs[i]);
+    }
+    FragmentationStats st = pool.fragmentation();
+    EXPECT_EQ(st.slot_size, 72u);
+    EXPECT_EQ(st.bytes_reserved, pool.stats().bytes_reserved);
+    EXPECT_EQ(st.blocks, st.bytes_reserved / 4096);
+    EXPECT_EQ(st.block_overhead + st.tail_waste + st.slots_total * st.slot_size, st.bytes_reserved);
+    EXPECT_EQ(st.slots_total, st.slots_live + st.slots_free + st.slots_uncarved);
+    EXPECT_EQ(st.slots_live, 70u);
+    EXPECT_EQ(st.slots_free, 30u);
+    EXPECT_GT(st.tail_waste, 0u);
+    EXPECT_LT(st.tail_waste, st.blocks * st.slot_size);
+    for(int i = 30; i < 100; ++i) {
+        pool.Deallocate(ptrs[i]);
+    }
+
+    // HashBucket requests are rounded up to the size class
+    const size_t index = SizeClass::index(65);
+#if ZP_ENABLE_STATS
+    const FragmentationStats before = HashBucket::fragmentationReport()[index];
+#endif
+    std::vector<void*> objects;
+    for(int i = 0; i < 10; ++i) {
+        objects.push_back(HashBucket::useMemory(65));
+    }
+    const FragmentationStats after = HashBucket::fragmentationReport()[index];
+    EXPECT_EQ(after.slot_size, SizeClass::size(index));
+    EXPECT_GE(after.slots_live, 10u);
+#if ZP_ENABLE_STATS
+    EXPECT_EQ(after.requests - before.requests, 10u);
+    EXPECT_EQ(after.bytes_requested - before.bytes_requested, 650u);
+    EXPECT_EQ(after.internalWaste() - before.internalWaste(), 10 * (SizeClass::size(index) - 65));
+#else
+    EXPECT_EQ(after.requests, 0u);
+#endif
+    for(void* p : objects) {
+        HashBucket::freeMemory(p, 65);
+    }
+
+    std::ostringstream os;
+    HashBucket::dumpFragmentation(os);
+    EXPECT_NE(os.str().find("tail_waste"), std::string::npos);
+    EXPECT_NE(os.str().find("\ntotal "), std::string::npos);
+}
+
+// Warm-up tests
+TEST_F(MemoryPoolTest, HeapProfilerSampling) {
+    constexpr size_t kSize = 1234;
+    auto ours = [](const std::vector<HeapSample>& samples) {
+        std::vector<HeapSample> result;
+        for(const HeapSample& s : samples) {
+            if(s.size == kSize) {
+                result.push_back(s);
+            }
+        }
+        return result;
+    };
+
+    // Nothing is recorded while the profiler is stopped
+    ASSERT_FALSE(HeapProfiler::active());
+    const size_t before = ours(HeapProfiler::samples()).size();
+    HashBucket::freeMemory(HashBucket::useMemory(kSize), kSize);
+    EXPECT_EQ(ours(HeapProfiler::samples()).size(), before);
+
+    // A mean distance of one byte samples every allocation
+    HeapProfiler::start(1);
+    std::vector<void*> ptrs;
+    for(int i = 0; i < 10; ++i) {
+        ptrs.push_back(HashBucket::useMemory(kSize));
+    }
+    for(int i = 0; i < 4; ++i) {
+        HashBucket::freeMemory(ptrs[i], kSize);
+    }
+    HeapProfiler::stop();
+
+    std::vector<HeapSample> samples = ours(HeapProfiler::samples());
+    ASSERT_EQ(samples.size(), 10u);
+    size_t live = 0;
+    for(size_t i = 0; i < samples.size(); ++i) {
+        EXPECT_EQ(samples[i].ptr, ptrs[i]);
+        EXPECT_EQ(samples[i].size_class, SizeClass::index(kSize));
+        EXPECT_NE(samples[i].thread, 0u);
+        EXPECT_GT(samples[i].depth, 0);
+        live += samples[i].live ? 1 : 0;
+    }
+    EXPECT_EQ(live, 6u);
+
+    std::ostringstream os;
+    HeapProfiler::dump(os);
+    const std::string profile = os.str();
+    EXPECT_EQ(profile.rfind("heap profile: ", 0), 0u);
+    EXPECT_NE(profile.find("@ heap_v2/1\n"), std::string::npos);
+    EXPECT_NE(profile.find(" @ 0x"), std::string::npos);
+    EXPECT_NE(profile.find("MAPPED_LIBRARIES:"), std::string::npos);
+    for(int i = 4; i < 10; ++i) {
+        HashBucket::freeMemory(ptrs[i], kSize);
+    }
+
+    // Container nodes from PoolAllocator are sampled too
+    HeapProfiler::start(1);
+    PoolAllocator<std::array<char, kSize>> alloc;
+    auto* node = alloc.allocate(1);
+    HeapProfiler::stop();
+    samples = ours(HeapProfiler::samples());
+    ASSERT_FALSE(samples.empty());
+    EXPECT_EQ(samples.back().ptr, node);
+    EXPECT_TRUE(samples.back().live);
+    alloc.deallocate(node, 1);
+
+    // Sparse sampling: 1 MiB in 1 KiB allocations at a 64 KiB mean is about 16 samples
+    HeapProfiler::start(64 * 1024);
+    for(int i = 0; i < 1024; ++i) {
+        HashBucket::freeMemory(HashBucket::useMemory(1024), 1024);
+    }
+    HeapProfiler::stop();
+    size_t sampled = 0;
+    for(const HeapSample& s : HeapProfiler::samples()) {
+        sampled += s.size == 1024 ? 1 : 0;
+    }
+    EXPECT_GE(sampled, 1u);
+    EXPECT_LE(sampled, 60u);
+
+    // Threads sample concurrently, and free each other's sampled memory
+    HeapProfiler::start(256);
+    std::vector<std::thread> threads;
+    std::vector<std::vector<void*>> handoff(4);
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&handoff, t] {
+            for(int i = 0; i < 2000; ++i) {
+                handoff[t].push_back(HashBucket::useMemory(49 + 16 * t));
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&handoff, t] {
+            for(void* p : handoff[(t + 1) % 4]) {
+                HashBucket::freeMemory(p, 49 + 16 * ((t + 1) % 4));
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    HeapProfiler::stop();
+    std::set<std::uint32_t> tids;
+    for(const HeapSample& s : HeapProfiler::samples()) {
+        if(s.size >= 49 && s.size <= 97 && s.size % 16 == 1) {
+            tids.insert(s.thread);
+            EXPECT_FALSE(s.live);
+        }
+    }
+    EXPECT_EQ(tids.size(), 4u);
+}
+
+TEST_F(MemoryPoolTest, MemoryPoolReserve) {
+    for(FreeListPolicy policy : {FreeListPolicy::Locked, FreeListPolicy::LockFree, FreeListPolicy::PerBlock}) {
+        MemoryPool pool(96, BlockSizePolicy{4096, 64 * 1024}, policy);
+        void* first = pool.Allocate();
+        size_t added = pool.Reserve(2000);
+        EXPECT_GE(added, 1900u);
+        size_t reserved = pool.stats().bytes_reserved;
+
+        // 2000 slots fit without another block, and Reserve() is idempotent
+        EXPECT_EQ(pool.Reserve(2000), 0u);
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 1999; ++i) {
+            ptrs.push_back(pool.Allocate());
+            std::memset(ptrs.back(), 0x5A, 96);
+        }
+        EXPECT_EQ(pool.stats().bytes_reserved, reserved);
+        std::set<void*> unique(ptrs.begin(), ptrs.end());
+        unique.insert(first);
+        EXPECT_EQ(unique.size(), 2000u);
+        for(void* ptr : ptrs) {
+            pool.Deallocate(ptr);
+        }
+        pool.Deallocate(first);
+    }
+}
+
+TEST_F(MemoryPoolTest, HashBucketWarmup) {
+    // A profile survives a dumpStats()/parseStats() round trip
+    void* ptr = HashBucket::useMemory(300);
+    std::ostringstream os;
+    HashBucket::dumpStats(os);
+    std::istringstream is(os.str());
+    auto parsed = HashBucket::parseStats(is);
+    auto stats = HashBucket::snapshotStats();
+    size_t index = SizeClass::index(300);
+    EXPECT_EQ(parsed[index].slot_size, stats[index].slot_size);
+    EXPECT_EQ(parsed[index].bytes_reserved, stats[index].bytes_reserved);
+    EXPECT_EQ(parsed[index].allocations, stats[index].allocations);
+    HashBucket::freeMemory(ptr, 300);
+
+    // Warm up one class, then its allocations do not grow the pool
+    constexpr size_t kSize = 20000;
+    constexpr int kCount = 64;
+    std::array<size_t, MEMORY_POOL_NUM> slots{};
+    slots[SizeClass::index(kSize)] = kCount;
+    HashBucket::warmup(slots);
+    MemoryPool& pool = HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(kSize)));
+    size_t reserved = pool.stats().bytes_reserved;
+    EXPECT_GE(reserved, kCount * SizeClass::size(SizeClass::index(kSize)));
+    std::vector<void*> ptrs;
+    for(int i = 0; i < kCount; ++i) {
+        ptrs.push_back(HashBucket::useMemory(kSize));
+    }
+    EXPECT_EQ(pool.stats().bytes_reserved, reserved);
+    for(void* p : ptrs) {
+        HashBucket::freeMemory(p, kSize);
+    }
+
+#if ZP_ENABLE_STATS
+    // The current stats describe what the pools already hold: nothing to add
+    // (with several shards, snapshotStats() also counts the other shards' pools)
+    std::array<PoolStats, MEMORY_POOL_NUM> own;
+    for(int i = 0; i < MEMORY_POOL_NUM; ++i) {
+        own[i] = HashBucket::getMemoryPool(i).stats();
+    }
+    EXPECT_EQ(HashBucket::warmup(HashBucket::poolShards() == 1 ? HashBucket::snapshotStats() : own), 0u);
+#endif
+}
+
+// Batch API tests
+TEST_F(MemoryPoolTest, BatchAllocateDeallocate) {
+    MemoryPool pool(4096);
+    pool.init(64);
+
+    // More than one block worth of slots
+    const size_t n = 200;
+    std::vector<void*> ptrs(n, nullptr);
+    pool.AllocateBatch(ptrs.data(), n);
+
+    std::set<void*> unique(ptrs.begin(), ptrs.end());
+    EXPECT_EQ(unique.size(), n);
+    EXPECT_EQ(unique.count(nullptr), 0u);
+    for(size_t i = 0; i < n; ++i) {
+        *static_cast<size_t*>(ptrs[i]) = i;
+    }
+    for(size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(*static_cast<size_t*>(ptrs[i]), i);
+    }
+
+    pool.DeallocateBatch(ptrs.data(), n);
+
+    // The freed batch is reused before any new block is carved
+    std::vector<void*> again(n, nullptr);
+    pool.AllocateBatch(again.data(), n);
+    EXPECT_EQ(std::set<void*>(again.begin(), again.end()), unique);
+    pool.DeallocateBatch(again.data(), n);
+}
+
+TEST_F(MemoryPoolTest, HashBucketBatchUsage) {
+    const size_t sizes[] = {0, 24, 512, 1024};
+    for(size_t size : sizes) {
+        std::vector<void*> ptrs(300, nullptr);
+        HashBucket::useMemoryBatch(size, ptrs.data(), ptrs.size());
+        for(void* ptr : ptrs) {
+            if(size == 0) {
+                EXPECT_EQ(ptr, nullptr);
+            } else {
+                ASSERT_NE(ptr, nullptr);
+            }
+        }
+        if(size != 0) {
+            EXPECT_EQ(std::set<void*>(ptrs.begin(), ptrs.end()).size(), ptrs.size());
+        }
+        HashBucket::freeMemoryBatch(ptrs.data(), size, ptrs.size());
+    }
+}
+
+// Thread cache tests
+TEST_F(MemoryPoolTest, ThreadCacheReusesFreedSlot) {
+    void* ptr = HashBucket::useMemory(48);
+    ASSERT_NE(ptr, nullptr);
+    HashBucket::freeMemory(ptr, 48);
+
+    // A slot freed on this thread is served again from the local cache
+    void* again = HashBucket::useMemory(48);
+    EXPECT_EQ(again, ptr);
+    HashBucket::freeMemory(again, 48);
+}
+
+TEST_F(MemoryPoolTest, ThreadCacheFlushAndThreadExit) {
+    const size_t batch = ThreadCache::batchSize(7); // 64-byte class
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([batch]() {
+            std::vector<void*> ptrs;
+            // Enough slots to force several refills and flushes
+            for(size_t i = 0; i < batch * 8; ++i) {
+                void* ptr = HashBucket::useMemory(64);
+                ASSERT_NE(ptr, nullptr);
+                *static_cast<size_t*>(ptr) = i;
+                ptrs.push_back(ptr);
+            }
+            for(size_t i = 0; i < ptrs.size(); ++i) {
+                EXPECT_EQ(*static_cast<size_t*>(ptrs[i]), i);
+                HashBucket::freeMemory(ptrs[i], 64);
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    // Slots returned by exiting threads must be usable from here
+    std::vector<void*> ptrs;
+    for(size_t i = 0; i < batch * 4; ++i) {
         void* ptr = HashBucket::useMemory(64);
-        pool_ptrs.push_back(ptr);
+        ASSERT_NE(ptr, nullptr);
+        ptrs.push_back(ptr);
     }
-    
-    for(void* ptr : pool_ptrs) {
+    for(void* ptr : ptrs) {
         HashBucket::freeMemory(ptr, 64);
     }
-    
-    auto pool_time = std::chrono::high_resolution_clock::now() - start;
-    
-    // Test standard allocation performance
-    start = std::chrono::high_resolution_clock::now();
-    
-    std::vector<void*> std_ptrs;
-    for(int i = 0; i < num_allocations; ++i) {
-        void* ptr = operator new(64);
-        std_ptrs.push_back(ptr);
+}
+
+TEST_F(MemoryPoolTest, RemoteFreeReturnsToOwner) {
+#if !ZP_ENABLE_REMOTE_FREE
+    GTEST_SKIP() << "built without ZP_ENABLE_REMOTE_FREE";
+#else
+    constexpr size_t kSize = 200;
+    constexpr int kCount = 100;
+    const size_t batch = ThreadCache::batchSize(SizeClass::index(kSize));
+    std::vector<void*> produced;
+    std::vector<void*> reused;
+    std::atomic<int> stage{0};
+
+    // Blocks stay with the first live heap that took slots from them: drain
+    // the free and uncarved slots left by earlier tests so that the
+    // producer's slots come from blocks of its own
+    ThreadCache::local().flushAll();
+    const FragmentationStats st = HashBucket::fragmentationReport()[SizeClass::index(kSize)];
+    const size_t filler = st.slots_free + st.slots_uncarved + batch;
+
+    // The producer allocates, the main thread frees, the producer gets the slots back
+    std::thread producer([&] {
+        std::vector<void*> taken;
+        for(size_t i = 0; i < filler; ++i) {
+            taken.push_back(HashBucket::useMemory(kSize));
+        }
+        for(int i = 0; i < kCount; ++i) {
+            produced.push_back(HashBucket::useMemory(kSize));
+        }
+        stage.store(1);
+        while(stage.load() != 2) {
+            std::this_thread::yield();
+        }
+        for(size_t i = 0; i < kCount + batch; ++i) {
+            reused.push_back(HashBucket::useMemory(kSize));
+        }
+        for(void* ptr : reused) {
+            HashBucket::freeMemory(ptr, kSize);
+        }
+        for(void* ptr : taken) {
+            HashBucket::freeMemory(ptr, kSize);
+        }
+    });
+    while(stage.load() != 1) {
+        std::this_thread::yield();
     }
-    
-    for(void* ptr : std_ptrs) {
-        operator delete(ptr);
+    for(void* ptr : produced) {
+        HashBucket::freeMemory(ptr, kSize);
     }
-    
-    auto std_time = std::chrono::high_resolution_clock::now() - start;
-    
-    // Memory pool should be faster or at least comparable
-    std::cout << "Memory pool time: " << std::chrono::duration_cast<std::chrono::microseconds>(pool_time).count() << "us" << std::endl;
-    std::cout << "Standard allocation time: " << std::chrono::duration_cast<std::chrono::microseconds>(std_time).count() << "us" << std::endl;
+    stage.store(2);
+    producer.join();
+
+    std::set<void*> again(reused.begin(), reused.end());
+    for(void* ptr : produced) {
+        EXPECT_TRUE(again.count(ptr)) << ptr;
+    }
+
+    // Slots of an exited thread's blocks stay with whoever frees them
+    void* orphan = nullptr;
+    std::thread([&] { orphan = HashBucket::useMemory(kSize); }).join();
+    HashBucket::freeMemory(orphan, kSize);
+    EXPECT_EQ(HashBucket::useMemory(kSize), orphan);
+    HashBucket::freeMemory(orphan, kSize);
+#endif
+}
+
+TEST_F(MemoryPoolTest, RemoteFreeRacesOwnerExit) {
+#if !ZP_ENABLE_REMOTE_FREE
+    GTEST_SKIP() << "built without ZP_ENABLE_REMOTE_FREE";
+#else
+    constexpr size_t kSize = 424;
+    constexpr int kCount = 200;
+    const size_t index = SizeClass::index(kSize);
+    // Cached slots count as live: after a flush only stranded ones would
+    auto flush = [] {
+        ThreadCache::local().flushAll();
+#if ZP_PER_CPU_CACHE
+        CpuCache::flushAll();
+#endif
+    };
+    flush();
+    const size_t live = HashBucket::fragmentationReport()[index].slots_live;
+
+    // The owner exits while the main thread is still freeing its slots:
+    // none of them may be stranded in the queue of the exited heap
+    for(int round = 0; round < 8; ++round) {
+        std::vector<void*> produced;
+        std::atomic<bool> ready{false};
+        std::thread owner([&] {
+            for(int i = 0; i < kCount; ++i) {
+                produced.push_back(HashBucket::useMemory(kSize));
+            }
+            ready.store(true);
+        });
+        while(!ready.load()) {
+            std::this_thread::yield();
+        }
+        for(void* ptr : produced) {
+            HashBucket::freeMemory(ptr, kSize);
+        }
+        owner.join();
+
+        flush();
+        EXPECT_EQ(HashBucket::fragmentationReport()[index].slots_live, live) << "round " << round;
+    }
+#endif
+}
+
+namespace {
+
+// Constructed before the thread's cache, so destroyed after it
+struct LateThreadExitUser {
+    std::atomic<int>* done = nullptr;
+    ~LateThreadExitUser() {
+        if(done == nullptr) {
+            return;
+        }
+        std::vector<void*> ptrs;
+        for(int i = 0; i < 100; ++i) {
+            ptrs.push_back(HashBucket::useMemory(48));
+        }
+        for(void* ptr : ptrs) {
+            HashBucket::freeMemory(ptr, 48);
+        }
+        ++*done;
+    }
+};
+
+} // namespace
+
+TEST_F(MemoryPoolTest, ThreadCacheAfterTeardown) {
+    std::atomic<int> done{0};
+    std::thread worker([&done]() {
+        thread_local LateThreadExitUser user;
+        user.done = &done;
+        HashBucket::freeMemory(HashBucket::useMemory(48), 48);
+    });
+    worker.join();
+    EXPECT_EQ(done.load(), 1);
+
+    // Everything the late destructor freed went back to the shared pool
+    MemoryPool& pool = HashBucket::getMemoryPool(static_cast<int>(SizeClass::index(48)));
+    std::vector<void*> ptrs(100);
+    pool.AllocateBatch(ptrs.data(), ptrs.size());
+    pool.DeallocateBatch(ptrs.data(), ptrs.size());
+}
+
+// Teardown: exit() while other threads still allocate and free
+TEST_F(MemoryPoolTest, TeardownAtExit) {
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    for (bool release : {true, false}) {
+        EXPECT_EXIT({
+            HashBucket::setReleaseAtExit(release);
+            constexpr size_t kSlots = 64;
+            static std::atomic<void*> handoff[kSlots];
+            static std::atomic<int> rounds{0};
+            // Keeps allocating and freeing through static destruction and past the pools' exit trim
+            std::thread([] {
+                const size_t sizes[] = {16, 48, 200, 1000, 4096, HashBucket::kMapThreshold};
+                for (size_t n = 0;; n++) {
+                    const size_t size = sizes[n % (sizeof(sizes) / sizeof(sizes[0]))];
+                    void* p = HashBucket::useMemory(size);
+                    std::memset(p, 0x5A, size);
+                    if (void* old = handoff[n % kSlots].exchange(p)) {
+                        HashBucket::freeMemory(old);
+                    }
+                    rounds.fetch_add(1, std::memory_order_release);
+                }
+            }).detach();
+            while (rounds.load(std::memory_order_acquire) < 1000) {
+                std::this_thread::yield();
+            }
+            // Cross-thread frees, and live pointers that are never freed
+            for (size_t i = 0; i < kSlots / 2; i++) {
+                if (void* p = handoff[i].exchange(nullptr)) {
+                    HashBucket::freeMemory(p);
+                }
+            }
+            for (int i = 0; i < 100; i++) {
+                HashBucket::useMemory(static_cast<size_t>(i) * 8 + 8);
+            }
+            std::exit(HashBucket::releaseAtExit() == release ? 0 : 1);
+        }, ::testing::ExitedWithCode(0), "");
+    }
+}
+
+// Per-CPU cache tests
+TEST_F(MemoryPoolTest, PerCpuCache) {
+#if !ZP_PER_CPU_CACHE
+    GTEST_SKIP() << "built without ZP_PER_CPU_CACHE";
+#else
+    const int cpu = CpuCache::currentCpu();
+    if(cpu < 0) {
+        GTEST_SKIP() << "rseq is not registered for this thread";
+    }
+    // Pin the workers to one CPU so they share its cache
+    auto pinned = [cpu](auto&& body) {
+        std::thread([&] {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            ASSERT_EQ(sched_setaffinity(0, sizeof(set), &set), 0);
+            ASSERT_EQ(CpuCache::currentCpu(), cpu);
+            body();
+        }).join();
+    };
+
+    // A slot freed by one thread is served to the next thread on that CPU
+    constexpr size_t kSize = 113;
+    void* freed = nullptr;
+    pinned([&] {
+        freed = HashBucket::useMemory(kSize);
+        HashBucket::freeMemory(freed, kSize);
+        EXPECT_GT(CpuCache::cachedSlots(cpu), 0u);
+    });
+    pinned([&] {
+        void* again = HashBucket::useMemory(kSize);
+        EXPECT_EQ(again, freed);
+        HashBucket::freeMemory(again, kSize);
+    });
+
+    // Container nodes from PoolAllocator share the CPU's cache as well
+    struct Node { char bytes[kSize]; };
+    pinned([&] {
+        PoolAllocator<Node> alloc;
+        Node* node = alloc.allocate(1);
+        const size_t cached = CpuCache::cachedSlots(cpu);
+        alloc.deallocate(node, 1);
+        EXPECT_EQ(CpuCache::cachedSlots(cpu), cached + 1);
+        freed = node;
+    });
+    pinned([&] {
+        void* again = HashBucket::useMemory(kSize);
+        EXPECT_EQ(again, freed);
+        HashBucket::freeMemory(again, kSize);
+    });
+
+    // Batches go through the same cache
+    pinned([&] {
+        std::vector<void*> ptrs(100);
+        HashBucket::useMemoryBatch(kSize, ptrs.data(), ptrs.size());
+        EXPECT_EQ(std::set<void*>(ptrs.begin(), ptrs.end()).size(), ptrs.size());
+        HashBucket::freeMemoryBatch(ptrs.data(), kSize, ptrs.size());
+    });
+
+    // trimAll() returns what every CPU caches to the pools
+    HashBucket::trimAll();
+    for(int i = 0; i < CpuCache::kMaxCpus; ++i) {
+        EXPECT_EQ(CpuCache::cachedSlots(i), 0u);
+    }
+#endif
 }
 
 int main(int argc, char **argv) {
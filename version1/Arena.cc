@@ -0,0 +1,70 @@
+#include "Arena.h"
+
+namespace ZPmemoryPool {
+
+namespace {
+
+constexpr size_t kMinChunkSize = 256;      // 再小的 chunk 几乎每次分配都要换新的
+
+constexpr size_t alignUp(size_t n, size_t align){
+    return (n + align - 1) & ~(align - 1);
+}
+
+constexpr size_t chunkSizeFor(size_t requested){
+    if(requested < kMinChunkSize){
+        requested = kMinChunkSize;
+    }
+    if(requested > MAX_SLOT_SIZE){
+        requested = MAX_SLOT_SIZE;
+    }
+    return SizeClass::size(SizeClass::index(requested));
+}
+
+} // namespace
+
+Arena::Arena(size_t chunk_size)
+: chunk_size_(chunkSizeFor(chunk_size))
+{}
+
+void* Arena::AllocateSlow(size_t size, size_t align){
+    if(sizeof(Chunk) + align - 1 + size > chunk_size_){
+        // 放不进一个 chunk：单独向 HashBucket 申请，头部放在对象前面
+        if(align < alignof(Large)){
+            align = alignof(Large);
+        }
+        const size_t offset = alignUp(sizeof(Large), align);
+        const size_t bytes = offset + size;
+        char* raw = static_cast<char*>(HashBucket::useMemory(bytes, align));
+        Large* large = new(raw) Large{large_, bytes, align};
+        large_ = large;
+        bytes_held_ += bytes;
+        return raw + offset;
+    }
+
+    // 当前 chunk 剩下的部分放不下，直接换新的 chunk，剩余部分不再使用
+    char* raw = static_cast<char*>(HashBucket::useMemory(chunk_size_));
+    chunk_ = new(raw) Chunk{chunk_};
+    cursor_ = raw + sizeof(Chunk);
+    limit_ = raw + chunk_size_;
+    bytes_held_ += chunk_size_;
+    return allocate(size, align);
+}
+
+void Arena::rewind(const Marker& marker){
+    while(large_ != marker.large){
+        Large* prev = large_->prev;
+        bytes_held_ -= large_->bytes;
+        HashBucket::freeMemory(large_, large_->bytes, large_->align);
+        large_ = prev;
+    }
+    while(chunk_ != marker.chunk){
+        Chunk* prev = chunk_->prev;
+        HashBucket::freeMemory(chunk_, chunk_size_);
+        bytes_held_ -= chunk_size_;
+        chunk_ = prev;
+    }
+    cursor_ = marker.cursor;
+    limit_ = chunk_ != nullptr ? reinterpret_cast<char*>(chunk_) + chunk_size_ : nullptr;
+}
+
+} // namespace ZPmemoryPool
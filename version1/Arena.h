@@ -0,0 +1,169 @@
+/**
+ * @file Arena.h
+ * @brief  Scoped bump-pointer arena whose chunks come from HashBucket
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_ARENA_H
+#define ZP_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ZPmemoryPool.h"
+
+namespace ZPmemoryPool {
+
+/**
+ * @class Arena
+ * @brief Monotonic allocator for scratch memory that is released all at once
+ *
+ * Allocations of any size and alignment are carved from chunks with a bump
+ * pointer; individual objects are never freed. release(), rewind() and the
+ * destructor give whole chunks back in one pass, so their cost depends on
+ * the number of chunks, not on the number of allocations.
+ *
+ * Chunks are slots of the largest HashBucket size class (32 KiB by
+ * default) and go back to the calling thread's cache, so a request loop
+ * that builds and drops an arena keeps reusing the same warm memory
+ * instead of going to the OS. Requests that do not fit in a chunk get a
+ * HashBucket allocation of their own, released together with the chunks.
+ *
+ * Nesting: mark() records the current position and rewind() returns to
+ * it, releasing everything allocated since; ArenaScope does this on scope
+ * exit.
+ *
+ * @note Not thread-safe; an arena belongs to one thread (or one request)
+ *       at a time. Destructors of objects placed in the arena are not run.
+ */
+class Arena{
+    struct Chunk{
+        Chunk* prev;        // 更早申请的 chunk
+    };
+    struct Large{
+        Large*  prev;       // 更早的大块分配
+        size_t  bytes;      // 向 HashBucket 申请的字节数
+        size_t  align;      // 向 HashBucket 申请时的对齐
+    };
+
+public:
+    /**
+     * @struct Marker
+     * @brief Position in an arena, see mark() and rewind()
+     */
+    struct Marker{
+        Chunk*  chunk = nullptr;
+        char*   cursor = nullptr;
+        Large*  large = nullptr;
+    };
+
+    /**
+     * @brief Constructor, no memory is taken until the first allocation
+     * @param chunk_size Chunk size in bytes, rounded up to a size class and capped at MAX_SLOT_SIZE
+     */
+    explicit Arena(size_t chunk_size = MAX_SLOT_SIZE);
+
+    /**
+     * @brief Destructor, releases every chunk
+     */
+    ~Arena(){ release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Allocate memory that lives until the next release()/rewind() past it
+     * @param size Requested size in bytes
+     * @param align Alignment, a power of two (default: alignof(std::max_align_t))
+     * @return Pointer to the memory
+     */
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)){
+        const std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(cursor_) + align - 1) & ~(std::uintptr_t(align) - 1);
+        if(cursor_ != nullptr && p + size <= reinterpret_cast<std::uintptr_t>(limit_)){
+            cursor_ = reinterpret_cast<char*>(p + size);
+            return reinterpret_cast<void*>(p);
+        }
+        return AllocateSlow(size, align);
+    }
+
+    /**
+     * @brief Construct an object in the arena
+     * @param args Constructor arguments
+     * @return Pointer to the object
+     *
+     * Restricted to trivially destructible types: the arena never runs
+     * destructors.
+     */
+    template<typename T, typename... Args>
+    T* create(Args&&... args){
+        static_assert(std::is_trivially_destructible_v<T>, "Arena never runs destructors");
+        return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Current position, to be passed to rewind()
+     */
+    Marker mark() const{ return Marker{chunk_, cursor_, large_}; }
+
+    /**
+     * @brief Release everything allocated after a marker
+     * @param marker Result of an earlier mark() on this arena, not rewound past since
+     */
+    void rewind(const Marker& marker);
+
+    /**
+     * @brief Release every allocation and give all chunks back to HashBucket
+     */
+    void release(){ rewind(Marker{}); }
+
+    /**
+     * @brief Bytes currently held from HashBucket (chunks and large allocations)
+     */
+    size_t bytesHeld() const{ return bytes_held_; }
+
+    /**
+     * @brief Chunk size in bytes
+     */
+    size_t chunkSize() const{ return chunk_size_; }
+
+private:
+    /**
+     * @brief Start a new chunk, or make a dedicated allocation, then retry
+     */
+    void* AllocateSlow(size_t size, size_t align);
+
+    size_t  chunk_size_;                // 每个 chunk 的大小，等于某个 size class
+    Chunk*  chunk_ = nullptr;           // 当前 chunk
+    char*   cursor_ = nullptr;          // 当前 chunk 中第一个未使用的字节
+    char*   limit_ = nullptr;           // 当前 chunk 的末尾
+    Large*  large_ = nullptr;           // 放不进 chunk 的分配，按申请顺序链起来
+    size_t  bytes_held_ = 0;            // 向 HashBucket 申请、尚未归还的字节数
+};
+
+/**
+ * @class ArenaScope
+ * @brief Rewinds an arena to the position it had when the scope was entered
+ *
+ * Scopes nest: an inner scope releases only what was allocated inside it.
+ */
+class ArenaScope{
+public:
+    explicit ArenaScope(Arena& arena) : arena_(arena), marker_(arena.mark()) {}
+    ~ArenaScope(){ arena_.rewind(marker_); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena&          arena_;
+    Arena::Marker   marker_;
+};
+
+} // namespace ZPmemoryPool
+
+#endif
@@ -0,0 +1,210 @@
+#include "BlockProvider.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+
+#if ZP_ENABLE_NUMA
+#include <numa.h>
+#endif
+
+namespace ZPmemoryPool {
+
+namespace {
+
+// 永不析构的单例：HashBucket 的内存池在静态析构阶段仍会归还 block
+template<typename T, typename... Args>
+T& leakySingleton(Args... args){
+    alignas(T) static unsigned char storage[sizeof(T)];
+    static T* instance = new(storage) T(args...);
+    return *instance;
+}
+
+void* mapAnonymous(size_t bytes, int extra_flags){
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+void adviseHugePages(void* p, size_t bytes){
+#ifdef MADV_HUGEPAGE
+    madvise(p, bytes, MADV_HUGEPAGE);
+#else
+    (void)p; (void)bytes;
+#endif
+}
+
+} // namespace
+
+BlockProvider& BlockProvider::defaultProvider(){
+    return leakySingleton<SystemBlockProvider>();
+}
+
+void BlockProvider::prefault(void* start, size_t bytes){
+#ifdef MADV_POPULATE_WRITE
+    // Linux 5.14+：一次系统调用建好页表，不需要逐页缺页
+    if(madvise(start, bytes, MADV_POPULATE_WRITE) == 0){
+        return;
+    }
+#endif
+    // 范围内没有活跃的槽，直接逐页写入
+    volatile char* p = static_cast<volatile char*>(start);
+    for(size_t offset = 0; offset < bytes; offset += PageMap::kPageSize){
+        p[offset] = 0;
+    }
+}
+
+void* SystemBlockProvider::allocate(size_t bytes){
+    // 不经过 operator new：全局 operator new 可能已被替换成 HashBucket
+    void* block = std::aligned_alloc(PageMap::kPageSize, bytes);
+    if(block == nullptr){
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void SystemBlockProvider::deallocate(void* block, size_t){
+    std::free(block);
+}
+
+#if ZP_ENABLE_NUMA
+namespace {
+
+bool numaSupported(){
+    static const bool supported = numa_available() >= 0;
+    return supported;
+}
+
+} // namespace
+#endif
+
+void* NumaBlockProvider::allocate(size_t bytes){
+#if ZP_ENABLE_NUMA
+    if(numaSupported()){
+        // numa_alloc_onnode 直接 mmap + mbind，天然按页对齐
+        void* block = numa_alloc_onnode(bytes, node_);
+        if(block == nullptr){
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+#endif
+    return BlockProvider::defaultProvider().allocate(bytes);
+}
+
+void NumaBlockProvider::deallocate(void* block, size_t bytes){
+#if ZP_ENABLE_NUMA
+    if(numaSupported()){
+        numa_free(block, bytes);
+        return;
+    }
+#endif
+    BlockProvider::defaultProvider().deallocate(block, bytes);
+}
+
+HugePageBlockProvider::HugePageBlockProvider(Mode mode, bool release_on_free)
+: mode_(mode), release_on_free_(release_on_free)
+{}
+
+HugePageBlockProvider::~HugePageBlockProvider(){
+    Region* region = regions_;
+    while(region != nullptr){
+        Region* next = region->next;
+        munmap(region, kRegionSize);
+        region = next;
+    }
+}
+
+HugePageBlockProvider& HugePageBlockProvider::instance(){
+    return leakySingleton<HugePageBlockProvider>(Mode::Transparent, true);
+}
+
+size_t HugePageBlockProvider::regions() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return region_count_;
+}
+
+char* HugePageBlockProvider::MapRegion(){
+    bool huge = false;
+    void* p = nullptr;
+#ifdef MAP_HUGETLB
+    if(mode_ == Mode::Explicit){
+        // hugetlbfs 映射天然按大页对齐；没有预留大页时退回透明大页
+        p = mapAnonymous(kRegionSize, MAP_HUGETLB);
+        huge = p != nullptr;
+    }
+#endif
+    if(p == nullptr){
+        // 多映射一个 region 的长度，再裁掉首尾，得到 2 MiB 对齐的区域
+        char* raw = static_cast<char*>(mapAnonymous(2 * kRegionSize, 0));
+        if(raw == nullptr){
+            throw std::bad_alloc();
+        }
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(raw);
+        char* aligned = reinterpret_cast<char*>((addr + kRegionSize - 1) & ~(std::uintptr_t(kRegionSize) - 1));
+        if(aligned != raw){
+            munmap(raw, aligned - raw);
+        }
+        munmap(aligned + kRegionSize, raw + 2 * kRegionSize - (aligned + kRegionSize));
+        adviseHugePages(aligned, kRegionSize);
+        p = aligned;
+    }
+
+    Region* region = static_cast<Region*>(p);
+    region->next = regions_;
+    region->huge = huge;
+    regions_ = region;
+    ++region_count_;
+    return static_cast<char*>(p);
+}
+
+void* HugePageBlockProvider::allocate(size_t bytes){
+    const size_t pages = bytes / PageMap::kPageSize;
+    if(pages >= kRegionPages){
+        // 比一个 region 还大的 block 单独映射
+        void* p = mapAnonymous(bytes, 0);
+        if(p == nullptr){
+            throw std::bad_alloc();
+        }
+        adviseHugePages(p, bytes);
+        return p;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 优先复用同样大小的已归还 block
+    if(FreeBlock* block = free_[pages]){
+        free_[pages] = block->next;
+        return block;
+    }
+    if(cursor_ == nullptr || static_cast<size_t>(limit_ - cursor_) < bytes){
+        // 当前 region 剩余部分放不下就丢弃，它只占虚拟地址，不占物理内存
+        char* region = MapRegion();
+        cursor_ = region + PageMap::kPageSize;
+        limit_ = region + kRegionSize;
+    }
+    void* block = cursor_;
+    cursor_ += bytes;
+    return block;
+}
+
+void HugePageBlockProvider::deallocate(void* block, size_t bytes){
+    const size_t pages = bytes / PageMap::kPageSize;
+    if(pages >= kRegionPages){
+        munmap(block, bytes);
+        return;
+    }
+
+    Region* region = reinterpret_cast<Region*>(
+        reinterpret_cast<std::uintptr_t>(block) & ~(std::uintptr_t(kRegionSize) - 1));
+    if(release_on_free_ && !region->huge){
+        // 归还物理页；下次复用时重新缺页，内容为零
+        madvise(block, bytes, MADV_DONTNEED);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    FreeBlock* free_block = static_cast<FreeBlock*>(block);
+    free_block->next = free_[pages];
+    free_[pages] = free_block;
+}
+
+} // namespace ZPmemoryPool
@@ -0,0 +1,198 @@
+/**
+ * @file BlockProvider.h
+ * @brief  Upstream sources of memory for MemoryPool blocks
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_BLOCK_PROVIDER_H
+#define ZP_BLOCK_PROVIDER_H
+
+#include <cstddef>
+#include <mutex>
+
+#include "PageMap.h"
+
+namespace ZPmemoryPool {
+
+/**
+ * @class BlockProvider
+ * @brief Interface MemoryPool uses to obtain and return whole blocks
+ *
+ * Requests are always a multiple of PageMap::kPageSize and the returned
+ * memory must be aligned to it. A block is handed back to the provider it
+ * came from, with the same size, so a pool can switch providers while it
+ * still holds older blocks.
+ *
+ * @note Implementations must be thread-safe: one provider is normally
+ *       shared by every pool. A provider must outlive all blocks it handed
+ *       out, which for the HashBucket pools means the whole process.
+ */
+class BlockProvider{
+public:
+    virtual ~BlockProvider() = default;
+
+    /**
+     * @brief Obtain a block
+     * @param bytes Size in bytes, a multiple of PageMap::kPageSize
+     * @return Page-aligned memory of at least bytes bytes
+     * @throw std::bad_alloc if no memory is available
+     */
+    virtual void* allocate(size_t bytes) = 0;
+
+    /**
+     * @brief Give a block back
+     * @param block Pointer returned by allocate()
+     * @param bytes The size passed to allocate()
+     */
+    virtual void deallocate(void* block, size_t bytes) = 0;
+
+    /**
+     * @brief Fault in the pages of a range of a block ahead of use
+     * @param start Page-aligned start address, inside a block from allocate()
+     * @param bytes Length in bytes (multiple of PageMap::kPageSize)
+     *
+     * Used by MemoryPool::Reserve() on memory that holds no live slots. The
+     * default asks the kernel to populate the range (MADV_POPULATE_WRITE)
+     * and falls back to writing one byte per page.
+     */
+    virtual void prefault(void* start, size_t bytes);
+
+    /**
+     * @brief Provider used by pools that were not given one
+     * @return The SystemBlockProvider instance
+     */
+    static BlockProvider& defaultProvider();
+};
+
+/**
+ * @class SystemBlockProvider
+ * @brief Page-aligned blocks from std::aligned_alloc()
+ *
+ * Deliberately bypasses operator new, so it keeps working when the global
+ * operator new is itself routed to HashBucket (ZPglobalNew.cc).
+ */
+class SystemBlockProvider : public BlockProvider{
+public:
+    void* allocate(size_t bytes) override;
+    void deallocate(void* block, size_t bytes) override;
+};
+
+/**
+ * @class NumaBlockProvider
+ * @brief Blocks bound to one NUMA node with numa_alloc_onnode()
+ *
+ * Without ZP_ENABLE_NUMA, or when the kernel reports no NUMA support, it
+ * behaves like SystemBlockProvider. The constructor is constexpr so the
+ * per-node HashBucket pools can refer to constant-initialized instances.
+ */
+class NumaBlockProvider : public BlockProvider{
+public:
+    /**
+     * @brief Constructor
+     * @param node NUMA node the blocks are placed on
+     */
+    constexpr explicit NumaBlockProvider(int node) : node_(node) {}
+
+    void* allocate(size_t bytes) override;
+    void deallocate(void* block, size_t bytes) override;
+
+    /**
+     * @brief Node this provider allocates on
+     * @return NUMA node id
+     */
+    int node() const { return node_; }
+
+private:
+    int node_;
+};
+
+/**
+ * @class HugePageBlockProvider
+ * @brief Blocks carved out of 2 MiB mmap regions backed by huge pages
+ *
+ * Regions are mapped 2 MiB aligned so the kernel can back each one with a
+ * single huge page, which cuts TLB misses when many slots are touched.
+ * Blocks are carved from the current region with a bump pointer; returned
+ * blocks are kept on per-size free lists and reused before a new region
+ * is mapped. Blocks larger than a region get a dedicated mapping that is
+ * unmapped when the block is returned.
+ *
+ * The first page of every region holds its bookkeeping. Regions stay
+ * mapped for the lifetime of the provider.
+ */
+class HugePageBlockProvider : public BlockProvider{
+public:
+    /// @brief Size and alignment of one region
+    static constexpr size_t kRegionSize = size_t(2) << 20;
+
+    /**
+     * @enum Mode
+     * @brief Kind of huge pages to ask the kernel for
+     */
+    enum class Mode{
+        Transparent,    ///< Anonymous mapping with madvise(MADV_HUGEPAGE)
+        Explicit        ///< MAP_HUGETLB from the reserved hugetlbfs pool, Transparent if that fails
+    };
+
+    /**
+     * @brief Constructor
+     * @param mode Huge page flavour (default: Transparent)
+     * @param release_on_free Drop the pages of returned blocks with
+     *        madvise(MADV_DONTNEED) so MemoryPool::Trim() lowers the RSS
+     *        (default: true). Ignored for explicit huge pages, which can't
+     *        be partially released.
+     */
+    explicit HugePageBlockProvider(Mode mode = Mode::Transparent, bool release_on_free = true);
+    ~HugePageBlockProvider() override;
+
+    HugePageBlockProvider(const HugePageBlockProvider&) = delete;
+    HugePageBlockProvider& operator=(const HugePageBlockProvider&) = delete;
+
+    void* allocate(size_t bytes) override;
+    void deallocate(void* block, size_t bytes) override;
+
+    /**
+     * @brief Number of regions mapped so far
+     * @return Count of 2 MiB regions (dedicated mappings are not counted)
+     */
+    size_t regions() const;
+
+    /**
+     * @brief Process-wide transparent huge page provider
+     * @return Provider that is never destroyed, safe for the HashBucket pools
+     */
+    static HugePageBlockProvider& instance();
+
+private:
+    static constexpr size_t kRegionPages = kRegionSize / PageMap::kPageSize;
+
+    struct FreeBlock{
+        FreeBlock* next;
+    };
+    // 每个 region 的第一页存放这个头部，block 从第二页开始切分
+    struct Region{
+        Region* next;
+        bool    huge;   // 区域是否来自 MAP_HUGETLB
+    };
+
+    /**
+     * @brief Map a new region, huge-page aligned
+     * @return Start of the region
+     */
+    char* MapRegion();
+
+    Mode                mode_;
+    bool                release_on_free_;
+    mutable std::mutex  mutex_;
+    Region*             regions_ = nullptr;         // 所有已映射的 region
+    size_t              region_count_ = 0;
+    char*               cursor_ = nullptr;          // 当前 region 中下一个可切分的位置
+    char*               limit_ = nullptr;           // 当前 region 的末尾
+    FreeBlock*          free_[kRegionPages + 1] = {}; // 按页数分组的已归还 block
+};
+
+} // namespace ZPmemoryPool
+
+#endif
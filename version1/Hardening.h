@@ -0,0 +1,258 @@
+/**
+ * @file Hardening.h
+ * @brief  Optional heap-corruption checks (ZP_HARDENED) and ASan annotations for free slots
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_HARDENING_H
+#define ZP_HARDENING_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "PageMap.h"
+
+/// @brief Compile the checks of class Hardening into every allocation and free (0 removes them entirely)
+#ifndef ZP_HARDENED
+#define ZP_HARDENED 0
+#endif
+
+/// @brief 1 when building with AddressSanitizer: free slots are then poisoned for ASan as well
+#if defined(__SANITIZE_ADDRESS__)
+#define ZP_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ZP_ASAN 1
+#endif
+#endif
+#ifndef ZP_ASAN
+#define ZP_ASAN 0
+#endif
+
+#if ZP_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+
+namespace ZPmemoryPool {
+
+/**
+ * @class Hardening
+ * @brief Hooks run on every slot entering or leaving a free list
+ *
+ * With ZP_HARDENED, a free slot holds its free-list link XOR-encoded with a
+ * process secret and its own address, followed by a canary word and poison
+ * bytes:
+ *
+ *     [ link ^ key(slot) | canary(slot) | 0xDF 0xDF ... ]
+ *
+ * - a freed slot already carrying its canary is a double free;
+ * - a slot whose canary or poison bytes changed while it was free was
+ *   written after free (or overrun by its neighbour) and is reported when
+ *   it is handed out again; only the first kPoisonCheckBytes are checked;
+ * - a decoded link that points outside every pool block means the free
+ *   list itself was overwritten, and is reported before it is followed.
+ *
+ * Pointer ownership (the slot belongs to a pool of the right size and
+ * starts on a slot boundary) is checked by MemoryPool::CheckSlot().
+ * Problems are reported on stderr and abort the process.
+ *
+ * Independently, when the library is built with AddressSanitizer, the
+ * bytes of a free slot past the pool's own header words are poisoned, so
+ * ASan reports the faulting access itself.
+ *
+ * All hooks compile to nothing without ZP_HARDENED and ASan.
+ */
+class Hardening{
+public:
+    /// @brief ZP_HARDENED as a constant for if constexpr
+    static constexpr bool kEnabled = ZP_HARDENED != 0;
+    /// @brief Bytes at the start of a free slot the pool writes itself (link, plus canary when hardened)
+    static constexpr size_t kHeaderBytes = kEnabled ? 2 * sizeof(std::uintptr_t) : sizeof(std::uintptr_t);
+    /// @brief Free slots are poisoned and verified up to this many bytes from their start
+    static constexpr size_t kPoisonCheckBytes = 256;
+    /// @brief Fill byte of free slots past the header
+    static constexpr unsigned char kPoisonByte = 0xDF;
+
+    /**
+     * @brief Value stored in a slot's link field
+     * @param where Slot holding the link
+     * @param next Slot the link points to (may be nullptr)
+     */
+    static std::uintptr_t encode(const void* where, const void* next){
+        if constexpr (kEnabled){
+            return reinterpret_cast<std::uintptr_t>(next) ^ key(where);
+        }else{
+            return reinterpret_cast<std::uintptr_t>(next);
+        }
+    }
+
+    /**
+     * @brief Slot a stored link points to
+     * @param where Slot holding the link
+     * @param stored Value written by encode()
+     *
+     * When hardened, aborts if the result is neither null nor inside a pool block.
+     */
+    static void* decode(const void* where, std::uintptr_t stored){
+        if constexpr (kEnabled){
+            void* next = reinterpret_cast<void*>(stored ^ key(where));
+            if(next != nullptr && PageMap::get(next) == nullptr){
+                fail("corrupted free list link", where);
+            }
+            return next;
+        }else{
+            return reinterpret_cast<void*>(stored);
+        }
+    }
+
+    /**
+     * @brief Slot handed back by the user: detect a double free, then poison it
+     * @param slot Slot being freed
+     * @param slot_size Slot size in bytes
+     */
+    static void onFree(void* slot, size_t slot_size){
+        if constexpr (kEnabled){
+            if(slot_size >= kHeaderBytes && loadWord(slot) == canary(slot)){
+                fail("double free", slot);
+            }
+        }
+        markFree(slot, slot_size);
+    }
+
+    /**
+     * @brief Poison a slot that becomes free without having been handed out
+     * @param slot Freshly carved slot about to be put on a free list
+     * @param slot_size Slot size in bytes
+     */
+    static void markFree(void* slot, size_t slot_size){
+        if constexpr (kEnabled){
+            if(slot_size >= kHeaderBytes){
+                storeWord(slot, canary(slot));
+                std::memset(static_cast<char*>(slot) + kHeaderBytes, kPoisonByte,
+                            (slot_size < kPoisonCheckBytes ? slot_size : kPoisonCheckBytes) - kHeaderBytes);
+            }
+        }
+#if ZP_ASAN
+        if(slot_size > kHeaderBytes){
+            ASAN_POISON_MEMORY_REGION(static_cast<char*>(slot) + kHeaderBytes, slot_size - kHeaderBytes);
+        }
+#else
+        (void)slot; (void)slot_size;
+#endif
+    }
+
+    /**
+     * @brief Slot carved from a block and handed to the user directly
+     * @param slot Freshly carved slot
+     * @param slot_size Slot size in bytes
+     *
+     * The block may reuse memory of a block released earlier, so a stale
+     * canary at this address must not be taken for a double free later.
+     */
+    static void onCarve(void* slot, size_t slot_size){
+        if constexpr (kEnabled){
+            if(slot_size >= kHeaderBytes){
+                storeWord(slot, 0);
+            }
+        }
+        (void)slot; (void)slot_size;
+    }
+
+    /**
+     * @brief Slot taken off a free list for the user: verify and unpoison it
+     * @param slot Slot being handed out
+     * @param slot_size Slot size in bytes
+     */
+    static void onAllocate(void* slot, size_t slot_size){
+#if ZP_ASAN
+        if(slot_size > kHeaderBytes){
+            ASAN_UNPOISON_MEMORY_REGION(static_cast<char*>(slot) + kHeaderBytes, slot_size - kHeaderBytes);
+        }
+#endif
+        if constexpr (kEnabled){
+            if(slot_size >= kHeaderBytes){
+                if(loadWord(slot) != canary(slot)){
+                    fail("free slot overwritten (use after free or overflow)", slot);
+                }
+                const unsigned char* bytes = static_cast<const unsigned char*>(slot) + kHeaderBytes;
+                const size_t length = (slot_size < kPoisonCheckBytes ? slot_size : kPoisonCheckBytes) - kHeaderBytes;
+                if(std::memcmp(bytes, kPoisonPattern.data(), length) != 0){
+                    size_t i = 0;
+                    while(bytes[i] == kPoisonByte){
+                        ++i;
+                    }
+                    fail("free slot overwritten (use after free or overflow)", bytes + i);
+                }
+                // 清掉 canary：用户从未写过就释放时不能被误判为重复释放
+                storeWord(slot, 0);
+            }
+        }
+        (void)slot; (void)slot_size;
+    }
+
+    /**
+     * @brief Make a whole block addressable again before it goes back to its provider
+     * @param start Block start
+     * @param bytes Block size in bytes
+     */
+    static void releaseRange(void* start, size_t bytes){
+#if ZP_ASAN
+        ASAN_UNPOISON_MEMORY_REGION(start, bytes);
+#else
+        (void)start; (void)bytes;
+#endif
+    }
+
+    /**
+     * @brief Report heap corruption on stderr and abort
+     * @param what Description of the problem
+     * @param ptr Address involved
+     */
+    [[noreturn]] static void fail(const char* what, const void* ptr);
+
+private:
+    // 密钥第一次使用时才生成：常量初始化的内存池可能在任何动态初始化之前就被使用
+    static std::uintptr_t secret(){
+        std::uintptr_t s = secret_.load(std::memory_order_relaxed);
+        return s != 0 ? s : makeSecret();
+    }
+    static std::uintptr_t makeSecret();
+
+    static std::uintptr_t key(const void* where){
+        return secret() ^ reinterpret_cast<std::uintptr_t>(where);
+    }
+    static std::uintptr_t canary(const void* slot){
+        return std::rotl(key(slot), 29) ^ 0x5A5A5A5A5A5A5A5Aull;
+    }
+
+    // 槽大小不一定是 8 的倍数（如独立 MemoryPool 的 12 字节槽），canary 字用 memcpy 读写
+    static std::uintptr_t loadWord(const void* slot){
+        std::uintptr_t word;
+        std::memcpy(&word, static_cast<const char*>(slot) + sizeof(std::uintptr_t), sizeof(word));
+        return word;
+    }
+    static void storeWord(void* slot, std::uintptr_t word){
+        std::memcpy(static_cast<char*>(slot) + sizeof(std::uintptr_t), &word, sizeof(word));
+    }
+
+    static constexpr std::array<unsigned char, kPoisonCheckBytes> makePattern(){
+        std::array<unsigned char, kPoisonCheckBytes> pattern{};
+        pattern.fill(kPoisonByte);
+        return pattern;
+    }
+    static const std::array<unsigned char, kPoisonCheckBytes> kPoisonPattern;
+
+    static inline constinit std::atomic<std::uintptr_t> secret_{0};
+};
+
+inline constexpr std::array<unsigned char, Hardening::kPoisonCheckBytes> Hardening::kPoisonPattern = Hardening::makePattern();
+
+} // namespace ZPmemoryPool
+
+#endif
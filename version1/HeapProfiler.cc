@@ -0,0 +1,283 @@
+#include "HeapProfiler.h"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <ostream>
+
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ZPmemoryPool {
+
+namespace {
+
+constexpr size_t kLiveTableSize = 2 * HeapProfiler::kRingSize;
+constexpr size_t kMaxProbe = 16;            // 探测这么多项仍找不到位置就不跟踪这次采样
+constexpr int kSkipFrames = 1;              // record() 自身
+
+// 环形缓冲中的一条采样。version 是一个 seqlock：写入时为 2*ticket+1，写完为 2*ticket+2。
+// 不用独立的 fence（ThreadSanitizer 不支持）：字段用 release 写、acquire 读，
+// 读到某次写入的字段就一定能看到它之前写的奇数 version，重新检查时发现被覆盖
+struct Record{
+    std::atomic<std::uint64_t>  version{0};
+    std::atomic<void*>          ptr{nullptr};
+    std::atomic<size_t>         size{0};
+    std::atomic<std::uint32_t>  size_class{0};
+    std::atomic<std::uint32_t>  thread{0};
+    std::atomic<int>            depth{0};
+    std::atomic<bool>           freed{false};
+    std::atomic<void*>          stack[HeapSample::kMaxDepth]{};
+};
+
+// 被采样指针 -> 采样的 ticket。开放寻址，删除时留下 kTombstone；
+// kBusy 表示这一项正在被写入，其他线程都把它当作已占用
+struct LiveEntry{
+    std::atomic<std::uintptr_t> ptr{0};
+    std::atomic<std::uint64_t>  ticket{0};
+};
+
+constexpr std::uintptr_t kTombstone = 1;
+constexpr std::uintptr_t kBusy = 2;
+
+constinit Record g_ring[HeapProfiler::kRingSize];
+constinit LiveEntry g_live[kLiveTableSize];
+constinit std::atomic<std::uint64_t> g_head{0};            // 下一个 ticket
+constinit std::atomic<std::uint64_t> g_session_start{0};   // 本轮第一个 ticket，更早的采样都已作废
+
+constinit thread_local std::uint64_t t_rng = 0;             // xorshift 状态，0 表示本线程还没有取过间隔
+constinit thread_local std::uint32_t t_tid = 0;
+constinit thread_local bool t_in_record = false;
+
+size_t slotOf(const void* ptr){
+    std::uint64_t h = reinterpret_cast<std::uintptr_t>(ptr) >> 4;
+    h *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(h >> 32) & (kLiveTableSize - 1);
+}
+
+std::uint64_t nextRandom(){
+    std::uint64_t x = t_rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    t_rng = x;
+    return x;
+}
+
+// 指数分布的采样间隔，均值 sample_bytes：被采样的概率只和分配大小有关
+std::int64_t nextInterval(size_t sample_bytes){
+    if(sample_bytes <= 1){
+        return 0;
+    }
+    // 取 53 位得到 (0, 1] 上的均匀数
+    const double u = (static_cast<double>(nextRandom() >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+    const double interval = -std::log(u) * static_cast<double>(sample_bytes);
+    return interval < 9.0e18 ? static_cast<std::int64_t>(interval) + 1 : INT64_MAX;
+}
+
+std::uint32_t currentThread(){
+    if(t_tid == 0){
+        t_tid = static_cast<std::uint32_t>(::syscall(SYS_gettid));
+    }
+    return t_tid;
+}
+
+void trackLive(void* ptr, std::uint64_t ticket){
+    const std::uint64_t oldest = g_session_start.load(std::memory_order_relaxed);
+    const std::uint64_t head = g_head.load(std::memory_order_relaxed);
+    const size_t start = slotOf(ptr);
+    for(size_t i = 0; i < kMaxProbe; ++i){
+        LiveEntry& entry = g_live[(start + i) & (kLiveTableSize - 1)];
+        std::uintptr_t cur = entry.ptr.load(std::memory_order_acquire);
+        if(cur == kBusy){
+            continue;
+        }
+        if(cur != 0 && cur != kTombstone){
+            // 采样已被覆盖或属于上一轮：这一项可以复用
+            const std::uint64_t t = entry.ticket.load(std::memory_order_relaxed);
+            if(t >= oldest && t + HeapProfiler::kRingSize > head){
+                continue;
+            }
+        }
+        if(entry.ptr.compare_exchange_strong(cur, kBusy, std::memory_order_acquire)){
+            entry.ticket.store(ticket, std::memory_order_relaxed);
+            entry.ptr.store(reinterpret_cast<std::uintptr_t>(ptr), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+} // namespace
+
+void HeapProfiler::start(size_t sample_bytes){
+    // 第一次 backtrace() 会加载 libgcc_s 并调用 malloc，提前在这里完成
+    void* warm[1];
+    ::backtrace(warm, 1);
+    sample_bytes_.store(sample_bytes == 0 ? 1 : sample_bytes, std::memory_order_relaxed);
+    g_session_start.store(g_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    active_.store(true, std::memory_order_release);
+}
+
+void HeapProfiler::stop(){
+    active_.store(false, std::memory_order_release);
+}
+
+void HeapProfiler::record(void* ptr, size_t size, size_t size_class){
+    const size_t sample_bytes = sampleBytes();
+    if(t_rng == 0){
+        // 本线程第一次：播种，从随机位置开始倒数，避免每个线程的第一次分配都被采样
+        t_rng = (static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())
+                 ^ reinterpret_cast<std::uintptr_t>(&t_rng)) | 1;
+        countdown_ += nextInterval(sample_bytes);
+        if(countdown_ > 0){
+            return;
+        }
+    }
+    countdown_ = nextInterval(sample_bytes);
+    if(t_in_record || ptr == nullptr){
+        return;
+    }
+    t_in_record = true;
+
+    void* frames[HeapSample::kMaxDepth + kSkipFrames];
+    int depth = ::backtrace(frames, HeapSample::kMaxDepth + kSkipFrames) - kSkipFrames;
+    if(depth < 0){
+        depth = 0;
+    }
+
+    const std::uint64_t ticket = g_head.fetch_add(1, std::memory_order_relaxed);
+    Record& r = g_ring[ticket & (kRingSize - 1)];
+    r.version.store(2 * ticket + 1, std::memory_order_relaxed);
+    r.ptr.store(ptr, std::memory_order_release);
+    r.size.store(size, std::memory_order_release);
+    r.size_class.store(static_cast<std::uint32_t>(size_class), std::memory_order_release);
+    r.thread.store(currentThread(), std::memory_order_release);
+    r.depth.store(depth, std::memory_order_release);
+    r.freed.store(false, std::memory_order_release);
+    for(int i = 0; i < depth; ++i){
+        r.stack[i].store(frames[i + kSkipFrames], std::memory_order_release);
+    }
+    r.version.store(2 * ticket + 2, std::memory_order_release);
+
+    trackLive(ptr, ticket);
+    t_in_record = false;
+}
+
+void HeapProfiler::onFree(void* ptr){
+    const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(ptr);
+    const size_t start = slotOf(ptr);
+    for(size_t i = 0; i < kMaxProbe; ++i){
+        LiveEntry& entry = g_live[(start + i) & (kLiveTableSize - 1)];
+        std::uintptr_t cur = entry.ptr.load(std::memory_order_acquire);
+        if(cur == 0){
+            return;
+        }
+        if(cur != key){
+            continue;
+        }
+        if(!entry.ptr.compare_exchange_strong(cur, kBusy, std::memory_order_acquire)){
+            return;
+        }
+        const std::uint64_t ticket = entry.ticket.load(std::memory_order_relaxed);
+        entry.ptr.store(kTombstone, std::memory_order_release);
+        Record& r = g_ring[ticket & (kRingSize - 1)];
+        if(r.version.load(std::memory_order_acquire) == 2 * ticket + 2){
+            r.freed.store(true, std::memory_order_relaxed);
+        }
+        return;
+    }
+}
+
+std::vector<HeapSample> HeapProfiler::samples(){
+    const std::uint64_t head = g_head.load(std::memory_order_acquire);
+    std::uint64_t first = g_session_start.load(std::memory_order_relaxed);
+    if(head - first > kRingSize){
+        first = head - kRingSize;
+    }
+    std::vector<HeapSample> result;
+    result.reserve(static_cast<size_t>(head - first));
+    for(std::uint64_t ticket = first; ticket < head; ++ticket){
+        const Record& r = g_ring[ticket & (kRingSize - 1)];
+        const std::uint64_t version = r.version.load(std::memory_order_acquire);
+        if(version != 2 * ticket + 2){
+            continue;   // 正在写入，或已被更新的采样覆盖
+        }
+        HeapSample s;
+        s.ptr = r.ptr.load(std::memory_order_acquire);
+        s.size = r.size.load(std::memory_order_acquire);
+        s.size_class = r.size_class.load(std::memory_order_acquire);
+        s.thread = r.thread.load(std::memory_order_acquire);
+        s.live = !r.freed.load(std::memory_order_acquire);
+        s.depth = r.depth.load(std::memory_order_acquire);
+        if(s.depth > HeapSample::kMaxDepth){
+            s.depth = HeapSample::kMaxDepth;
+        }
+        for(int i = 0; i < s.depth; ++i){
+            s.stack[i] = r.stack[i].load(std::memory_order_acquire);
+        }
+        // 前面的 acquire 读保证这次读不会提前
+        if(r.version.load(std::memory_order_relaxed) != version){
+            continue;
+        }
+        result.push_back(s);
+    }
+    return result;
+}
+
+void HeapProfiler::dump(std::ostream& os){
+    struct Totals{
+        std::uint64_t inuse_objects = 0;
+        std::uint64_t inuse_bytes = 0;
+        std::uint64_t alloc_objects = 0;
+        std::uint64_t alloc_bytes = 0;
+
+        void add(const HeapSample& s){
+            ++alloc_objects;
+            alloc_bytes += s.size;
+            if(s.live){
+                ++inuse_objects;
+                inuse_bytes += s.size;
+            }
+        }
+    };
+
+    // 按调用栈合并采样；数值是采样本身，pprof 根据 heap_v2/<间隔> 按概率放大
+    Totals total;
+    std::map<std::vector<void*>, Totals> stacks;
+    for(const HeapSample& s : samples()){
+        total.add(s);
+        stacks[std::vector<void*>(s.stack, s.stack + s.depth)].add(s);
+    }
+
+    os << "heap profile: " << total.inuse_objects << ": " << total.inuse_bytes
+       << " [" << total.alloc_objects << ": " << total.alloc_bytes << "] @ heap_v2/" << sampleBytes() << "\n";
+    const std::ios_base::fmtflags flags = os.flags();
+    for(const auto& [stack, t] : stacks){
+        os << std::dec << t.inuse_objects << ": " << t.inuse_bytes
+           << " [" << t.alloc_objects << ": " << t.alloc_bytes << "] @";
+        for(void* pc : stack){
+            os << " 0x" << std::hex << reinterpret_cast<std::uintptr_t>(pc);
+        }
+        os << "\n";
+    }
+    os.flags(flags);
+
+    // pprof 用内存映射把地址对应到可执行文件和共享库
+    os << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    if(maps){
+        os << maps.rdbuf();
+    }
+}
+
+bool HeapProfiler::dumpToFile(const char* path){
+    std::ofstream out(path, std::ios::trunc);
+    if(!out){
+        return false;
+    }
+    dump(out);
+    return static_cast<bool>(out.flush());
+}
+
+} // namespace ZPmemoryPool
@@ -0,0 +1,154 @@
+/**
+ * @file HeapProfiler.h
+ * @brief  Sampling heap profiler for HashBucket allocations, with pprof output
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_HEAP_PROFILER_H
+#define ZP_HEAP_PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace ZPmemoryPool {
+
+/**
+ * @struct HeapSample
+ * @brief One sampled allocation, as returned by HeapProfiler::samples()
+ */
+struct HeapSample{
+    /// @brief Frames kept per sample
+    static constexpr int kMaxDepth = 32;
+
+    void*           ptr = nullptr;          ///< Address handed out
+    size_t          size = 0;               ///< Bytes requested
+    size_t          size_class = 0;         ///< Size class index, MEMORY_POOL_NUM for allocations no pool serves
+    std::uint32_t   thread = 0;             ///< Kernel thread id of the allocating thread
+    bool            live = false;           ///< Not freed yet, as far as the profiler saw
+    int             depth = 0;              ///< Number of entries of stack in use
+    void*           stack[kMaxDepth] = {};  ///< Return addresses, innermost first
+};
+
+/**
+ * @class HeapProfiler
+ * @brief Samples HashBucket allocations roughly every N bytes, like tcmalloc's sampler
+ *
+ * While started, every thread counts down the bytes it allocates through
+ * HashBucket::useMemory()/useMemoryBatch(); the allocation that crosses
+ * zero is sampled and the next distance is drawn from an exponential
+ * distribution with mean sampleBytes(). An allocation of s bytes is thus
+ * sampled with probability 1 - exp(-s / sampleBytes()), independent of the
+ * allocation pattern, which is what pprof assumes when scaling the
+ * samples back up.
+ *
+ * A sample (size, size class, thread and backtrace) goes into a fixed
+ * ring buffer of kRingSize records claimed with one fetch_add, so
+ * concurrent threads never wait for each other; when the ring is full the
+ * oldest samples are overwritten. Sampled pointers are also kept in a
+ * small lock-free table, so a later freeMemory() of one marks its sample
+ * as no longer live.
+ *
+ * When the profiler is stopped the hooks in HashBucket cost one relaxed
+ * load and a predictable branch. When it runs, every free additionally
+ * probes the pointer table; use it to find the callers driving pool
+ * growth, not as an always-on tracer.
+ *
+ * @note Allocations from a standalone MemoryPool or ObjectPool bypass
+ *       HashBucket and are not sampled.
+ */
+class HeapProfiler{
+public:
+    /// @brief Default mean distance between samples in bytes (as in tcmalloc)
+    static constexpr size_t kDefaultSampleBytes = 512 * 1024;
+    /// @brief Samples kept; older ones are overwritten
+    static constexpr size_t kRingSize = 4096;
+
+    /**
+     * @brief Start sampling, discarding the samples of any earlier run
+     * @param sample_bytes Mean number of allocated bytes between two samples (1 samples everything)
+     */
+    static void start(size_t sample_bytes = kDefaultSampleBytes);
+
+    /**
+     * @brief Stop sampling; the samples taken so far stay available
+     */
+    static void stop();
+
+    /**
+     * @brief Whether the allocation hooks are armed
+     */
+    static bool active(){
+        return active_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Mean distance between samples of the current or last run
+     */
+    static size_t sampleBytes(){
+        return sample_bytes_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Allocation hook, called by HashBucket while active()
+     * @param ptr Memory handed out
+     * @param size Bytes requested
+     * @param size_class Size class index, MEMORY_POOL_NUM if no pool serves the size
+     */
+    static void onAllocate(void* ptr, size_t size, size_t size_class){
+        countdown_ -= static_cast<std::int64_t>(size);
+        if(countdown_ <= 0){
+            record(ptr, size, size_class);
+        }
+    }
+
+    /**
+     * @brief Free hook, called by HashBucket while active() before the memory is reused
+     * @param ptr Memory being freed
+     */
+    static void onFree(void* ptr);
+
+    /**
+     * @brief Copy out the samples of the current or last run, oldest first
+     * @return Samples still in the ring buffer; records being written concurrently are skipped
+     */
+    static std::vector<HeapSample> samples();
+
+    /**
+     * @brief Write samples() as a pprof heap profile
+     * @param os Output stream
+     *
+     * Uses the legacy text format of tcmalloc heap profiles ("heap_v2"),
+     * samples grouped by stack with in-use and allocated counts, followed
+     * by the process's memory map so pprof can symbolize the addresses:
+     *
+     *     pprof --text <binary> <file>
+     */
+    static void dump(std::ostream& os);
+
+    /**
+     * @brief dump() into a file
+     * @param path File to create or truncate
+     * @return false if the file could not be written
+     */
+    static bool dumpToFile(const char* path);
+
+private:
+    /**
+     * @brief Take a sample, or just draw the first distance of a fresh thread
+     */
+    static void record(void* ptr, size_t size, size_t size_class);
+
+    static inline constinit std::atomic<bool>   active_{false};
+    static inline constinit std::atomic<size_t> sample_bytes_{kDefaultSampleBytes};
+    // 每个线程距离下一次采样还剩的字节数，只在 active() 时更新
+    static inline constinit thread_local std::int64_t countdown_ = 0;
+};
+
+} // namespace ZPmemoryPool
+
+#endif
@@ -0,0 +1,217 @@
+/**
+ * @file ObjectPool.h
+ * @brief  Typed object pool with a compile-time slot size
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_OBJECT_POOL_H
+#define ZP_OBJECT_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "ZPmemoryPool.h"
+
+namespace ZPmemoryPool {
+
+/**
+ * @enum ObjectReuse
+ * @brief What ObjectPool::deleteElement() does with an object
+ */
+enum class ObjectReuse{
+    Destroy,            ///< Run ~T and give the slot back to the pool
+    KeepConstructed     ///< Park the object as is; newElement() hands it out again without constructing it
+};
+
+/**
+ * @class ObjectPool
+ * @brief Pool of objects of a single type, built on one dedicated MemoryPool
+ * @tparam T Object type
+ * @tparam BlockSize Size of every block of the underlying pool in bytes
+ * @tparam Reuse ObjectReuse::Destroy (default) or ObjectReuse::KeepConstructed
+ *
+ * The slot size is a compile-time constant and the pool is dedicated to T:
+ * no size-class lookup, no pool index check. With ObjectReuse::Destroy,
+ * newElement() and deleteElement() go straight to MemoryPool::Allocate()
+ * and MemoryPool::Deallocate(), so released slots are free in
+ * pool().stats() and pool().Trim() can release idle blocks at any time.
+ * The constructor is constexpr, so a static ObjectPool is
+ * constant-initialized and usable at any time.
+ *
+ * With ObjectReuse::KeepConstructed, released objects keep their state and
+ * their resources (a reserved vector, an initialized mutex, ...) and are
+ * parked on a list of the ObjectPool itself. The list link sits in front of
+ * the object, so its bytes are never overwritten; the constructor runs only
+ * when no parked object is available, and the destructor only in clear()
+ * and ~ObjectPool.
+ *
+ * @note Thread-safe like MemoryPool. Objects still in use when the pool is
+ *       destroyed are not destructed, their memory is released anyway.
+ */
+template<typename T, size_t BlockSize = 4096, ObjectReuse Reuse = ObjectReuse::Destroy>
+class ObjectPool{
+    static constexpr bool kKeep = Reuse == ObjectReuse::KeepConstructed;
+
+    // KeepConstructed 模式下的槽：链接指针放在对象前面，对象本身不被覆盖；
+    // Destroy 模式下槽里的对象已析构，MemoryPool 的链接（Slot）直接复用对象的前 8 字节
+    struct Node{
+        Slot    link;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* object(){ return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    static_assert(alignof(T) <= SizeClass::kMaxAlignment, "ObjectPool cannot align beyond 4 KiB");
+
+public:
+    /// @brief Slot size of the underlying MemoryPool in bytes
+    static constexpr size_t kSlotSize = kKeep ? sizeof(Node)
+        : (sizeof(T) < sizeof(Slot) ? sizeof(Slot) : (sizeof(T) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot));
+
+    // MemoryPool 按槽大小对齐槽，槽大小必须让每个槽都能放下对齐的 Slot 链接（如 12 字节的 T 取 16）
+    static_assert(kSlotSize % alignof(Slot) == 0, "ObjectPool slots must be aligned for the free-list link");
+
+    /**
+     * @brief Constructor
+     * @param policy Synchronization used for the free list of the pool (default: Locked)
+     * @param provider Source of the blocks (default: nullptr, BlockProvider::defaultProvider())
+     */
+    constexpr explicit ObjectPool(FreeListPolicy policy = FreeListPolicy::Locked, BlockProvider* provider = nullptr)
+    : pool_(kSlotSize, BlockSizePolicy{BlockSize, BlockSize}, policy, provider)
+    {}
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    /**
+     * @brief Destructor, destroys every parked object (KeepConstructed) and releases all blocks
+     */
+    ~ObjectPool(){ clear(); }
+
+    /**
+     * @brief Get an object
+     * @param args Constructor arguments
+     * @return Pointer to the object
+     *
+     * With KeepConstructed, a parked object is returned as it was released
+     * and args are ignored; they are only used to construct a new object.
+     * If the constructor throws, the slot goes back to the pool.
+     */
+    template<typename... Args>
+    T* newElement(Args&&... args){
+        void* slot = nullptr;
+        if constexpr (kKeep){
+            if((slot = pop()) != nullptr){
+                return static_cast<Node*>(slot)->object();
+            }
+        }
+        slot = pool_.Allocate();
+        try{
+            if constexpr (kKeep){
+                new(static_cast<Node*>(slot)->storage) T(std::forward<Args>(args)...);
+                return static_cast<Node*>(slot)->object();
+            }else{
+                return new(slot) T(std::forward<Args>(args)...);
+            }
+        }catch(...){
+            // 新槽还给内存池：KeepConstructed 下缓存链表里的槽必须是已构造的
+            pool_.Deallocate(slot);
+            throw;
+        }
+    }
+
+    /**
+     * @brief Release an object obtained from newElement()
+     * @param p Object to release (nullptr is ignored)
+     */
+    void deleteElement(T* p){
+        if(p == nullptr){
+            return;
+        }
+        if constexpr (kKeep){
+            // 对象保持构造状态，挂到缓存链表上等待复用
+            push(reinterpret_cast<unsigned char*>(p) - offsetof(Node, storage));
+        }else{
+            p->~T();
+            pool_.Deallocate(p);
+        }
+    }
+
+    /**
+     * @brief Destroy the parked objects and give their slots back to the pool
+     * @return Number of slots handed back
+     *
+     * Only KeepConstructed parks objects, and it keeps every released one
+     * until clear() or ~ObjectPool: the parked objects count as live in
+     * pool().stats() and hold their blocks. Afterwards pool().Trim() can
+     * release the blocks that became idle. With Destroy, slots are returned
+     * to the pool as they are released, so this returns 0.
+     */
+    size_t clear(){
+        Slot* slot = nullptr;
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot = cached_;
+            count = cached_count_;
+            cached_ = nullptr;
+            cached_count_ = 0;
+        }
+        while(slot != nullptr){
+            Slot* next = slot->getNext();
+            if constexpr (kKeep){
+                reinterpret_cast<Node*>(slot)->object()->~T();
+            }
+            pool_.Deallocate(slot);
+            slot = next;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Number of parked objects waiting for reuse
+     * @return Parked objects with KeepConstructed; always 0 with Destroy
+     */
+    size_t cached() const{
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cached_count_;
+    }
+
+    /**
+     * @brief The underlying pool, e.g. for stats() or Trim()
+     * @return Reference to the MemoryPool
+     */
+    MemoryPool& pool(){ return pool_; }
+
+private:
+    void* pop(){
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot* slot = cached_;
+        if(slot != nullptr){
+            cached_ = slot->getNext();
+            --cached_count_;
+        }
+        return slot;
+    }
+
+    void push(void* ptr){
+        Slot* slot = static_cast<Slot*>(ptr);
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->setNext(cached_);
+        cached_ = slot;
+        ++cached_count_;
+    }
+
+    MemoryPool          pool_;                  // 槽大小在编译期确定的专用内存池
+    mutable std::mutex  mutex_;                 // 保护 cached_ 链表
+    Slot*               cached_ = nullptr;      // KeepConstructed 下已释放、等待复用的对象（仍处于构造状态）
+    size_t              cached_count_ = 0;      // cached_ 链表长度
+};
+
+} // namespace ZPmemoryPool
+
+#endif
@@ -0,0 +1,71 @@
+#include "PageMap.h"
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace ZPmemoryPool {
+
+constinit std::atomic<PageMap::Mid*> PageMap::root_[PageMap::kFanout] = {};
+
+namespace {
+
+// 只有写入方需要互斥，读取完全无锁
+std::mutex& pageMapMutex(){
+    static std::mutex mutex;
+    return mutex;
+}
+
+// 节点用 calloc 分配：不经过 operator new，且全零正好是空节点
+template<typename Node>
+Node* allocateNode(){
+    void* node = std::calloc(1, sizeof(Node));
+    if(node == nullptr){
+        throw std::bad_alloc();
+    }
+    return static_cast<Node*>(node);
+}
+
+} // namespace
+
+void PageMap::set(const void* start, size_t bytes, BlockHeader* header){
+    assert(reinterpret_cast<std::uintptr_t>(start) % kPageSize == 0);
+    std::lock_guard<std::mutex> lock(pageMapMutex());
+    std::uintptr_t page = reinterpret_cast<std::uintptr_t>(start) >> kPageShift;
+    const std::uintptr_t end = page + (bytes + kPageSize - 1) / kPageSize;
+    for(; page < end; ++page){
+        assert((page >> (2 * kLevelBits)) < kFanout);
+        std::atomic<Mid*>& mid_slot = root_[page >> (2 * kLevelBits)];
+        Mid* mid = mid_slot.load(std::memory_order_relaxed);
+        if(mid == nullptr){
+            mid = allocateNode<Mid>();
+            mid_slot.store(mid, std::memory_order_release);
+        }
+        std::atomic<Leaf*>& leaf_slot = mid->leaves[(page >> kLevelBits) & kLevelMask];
+        Leaf* leaf = leaf_slot.load(std::memory_order_relaxed);
+        if(leaf == nullptr){
+            leaf = allocateNode<Leaf>();
+            leaf_slot.store(leaf, std::memory_order_release);
+        }
+        leaf->blocks[page & kLevelMask].store(header, std::memory_order_release);
+    }
+}
+
+void PageMap::clear(const void* start, size_t bytes){
+    std::lock_guard<std::mutex> lock(pageMapMutex());
+    std::uintptr_t page = reinterpret_cast<std::uintptr_t>(start) >> kPageShift;
+    const std::uintptr_t end = page + (bytes + kPageSize - 1) / kPageSize;
+    for(; page < end; ++page){
+        Mid* mid = root_[page >> (2 * kLevelBits)].load(std::memory_order_relaxed);
+        if(mid == nullptr){
+            continue;
+        }
+        Leaf* leaf = mid->leaves[(page >> kLevelBits) & kLevelMask].load(std::memory_order_relaxed);
+        if(leaf == nullptr){
+            continue;
+        }
+        leaf->blocks[page & kLevelMask].store(nullptr, std::memory_order_release);
+    }
+}
+
+} // namespace ZPmemoryPool
@@ -0,0 +1,92 @@
+/**
+ * @file PageMap.h
+ * @brief  Radix tree mapping page addresses to the pool block that owns them
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_PAGE_MAP_H
+#define ZP_PAGE_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ZPmemoryPool {
+
+struct BlockHeader;
+
+/**
+ * @class PageMap
+ * @brief Process-wide map from a 4 KiB page to the BlockHeader covering it
+ *
+ * Every pool block is page aligned and a whole number of pages long, so
+ * each page belongs to at most one block. The map is a three-level radix
+ * tree over 48-bit virtual addresses (12 bits per level); interior nodes
+ * are created on demand and never freed, which keeps get() lock-free.
+ *
+ * @note get() is safe to call concurrently with set()/clear(); writers are
+ *       serialized internally.
+ */
+class PageMap{
+public:
+    /// @brief log2 of the page granularity
+    static constexpr size_t kPageShift = 12;
+    /// @brief Page granularity in bytes; pool blocks are aligned to it
+    static constexpr size_t kPageSize = size_t(1) << kPageShift;
+
+    /**
+     * @brief Find the block that contains an address
+     * @param p Any address
+     * @return The owning block, or nullptr if p is not inside a pool block
+     */
+    static BlockHeader* get(const void* p){
+        const std::uintptr_t page = reinterpret_cast<std::uintptr_t>(p) >> kPageShift;
+        if((page >> (2 * kLevelBits)) >= kFanout){
+            return nullptr;
+        }
+        Mid* mid = root_[page >> (2 * kLevelBits)].load(std::memory_order_acquire);
+        if(mid == nullptr){
+            return nullptr;
+        }
+        Leaf* leaf = mid->leaves[(page >> kLevelBits) & kLevelMask].load(std::memory_order_acquire);
+        if(leaf == nullptr){
+            return nullptr;
+        }
+        return leaf->blocks[page & kLevelMask].load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Map every page of [start, start + bytes) to header
+     * @param start Page-aligned start address
+     * @param bytes Length in bytes (multiple of kPageSize)
+     * @param header Block that owns the range
+     */
+    static void set(const void* start, size_t bytes, BlockHeader* header);
+
+    /**
+     * @brief Remove the mapping of every page of [start, start + bytes)
+     * @param start Page-aligned start address
+     * @param bytes Length in bytes (multiple of kPageSize)
+     */
+    static void clear(const void* start, size_t bytes);
+
+private:
+    static constexpr size_t kLevelBits = 12;
+    static constexpr size_t kFanout = size_t(1) << kLevelBits;
+    static constexpr size_t kLevelMask = kFanout - 1;
+
+    struct Leaf{
+        std::atomic<BlockHeader*> blocks[kFanout];
+    };
+    struct Mid{
+        std::atomic<Leaf*> leaves[kFanout];
+    };
+
+    static std::atomic<Mid*> root_[kFanout];
+};
+
+} // namespace ZPmemoryPool
+
+#endif
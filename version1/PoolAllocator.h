@@ -0,0 +1,134 @@
+/**
+ * @file PoolAllocator.h
+ * @brief  Standard allocator and std::pmr::memory_resource adapters over HashBucket
+ * @author pan
+ * @date 2025-07-09
+ * @version 1.0
+ */
+
+#ifndef ZP_POOL_ALLOCATOR_H
+#define ZP_POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+#include "ZPmemoryPool.h"
+
+namespace ZPmemoryPool {
+
+/**
+ * @class PoolAllocator
+ * @brief Allocator (in the sense of the standard Allocator requirements) backed by HashBucket
+ * @tparam T Value type
+ *
+ * Stateless: all instances compare equal and share the HashBucket pools.
+ * Node-based containers (std::list, std::map, std::unordered_map, ...)
+ * always allocate one node at a time; for n == 1 the size class is fixed
+ * at compile time from sizeof(T) and alignof(T), and the request goes
+ * straight to the per-CPU or thread cache (HashBucket::useClass) without
+ * any runtime size computation, and is sampled by the HeapProfiler.
+ *
+ * Over-aligned T is honored: the class is chosen with
+ * SizeClass::index(size, align), and alignments no class provides fall
+ * back to the aligned operator new.
+ */
+template<typename T>
+class PoolAllocator{
+public:
+    using value_type = T;
+
+    constexpr PoolAllocator() noexcept = default;
+
+    template<typename U>
+    constexpr PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    /**
+     * @brief Allocate uninitialized storage for n objects
+     * @param n Number of objects
+     * @return Pointer to the storage
+     * @throw std::bad_array_new_length if n * sizeof(T) overflows
+     */
+    T* allocate(size_t n){
+        if constexpr (kIndex < MEMORY_POOL_NUM){
+            if(n == 1){
+                return static_cast<T*>(HashBucket::useClass(kIndex, sizeof(T)));
+            }
+        }
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T)){
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(HashBucket::useMemory(n * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * @brief Release storage obtained from allocate()
+     * @param p Pointer returned by allocate(n)
+     * @param n The same n
+     */
+    void deallocate(T* p, size_t n) noexcept{
+        if constexpr (kIndex < MEMORY_POOL_NUM){
+            if(n == 1){
+                HashBucket::freeClass(p, kIndex);
+                return;
+            }
+        }
+        HashBucket::freeMemory(p, n * sizeof(T), alignof(T));
+    }
+
+    template<typename U>
+    friend constexpr bool operator==(const PoolAllocator&, const PoolAllocator<U>&) noexcept { return true; }
+
+private:
+    // sizeof(T)、alignof(T) 在编译期确定所属的 size class，放不下时为 MEMORY_POOL_NUM
+    static constexpr size_t kIndex = SizeClass::index(sizeof(T), alignof(T));
+};
+
+/**
+ * @class PoolMemoryResource
+ * @brief std::pmr::memory_resource that allocates from HashBucket
+ *
+ * Thin forwarder to HashBucket::useMemory(bytes, alignment): the smallest
+ * size class aligned enough serves the request, everything else (larger
+ * than MAX_SLOT_SIZE or aligned beyond 4 KiB) goes to the aligned global
+ * operator new. The choice depends only on (bytes, alignment), so
+ * deallocation takes the same route.
+ *
+ * All instances are interchangeable and compare equal.
+ */
+class PoolMemoryResource : public std::pmr::memory_resource{
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override{
+        if(bytes == 0){
+            bytes = 1;
+        }
+        return HashBucket::useMemory(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override{
+        if(bytes == 0){
+            bytes = 1;
+        }
+        HashBucket::freeMemory(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override{
+        return dynamic_cast<const PoolMemoryResource*>(&other) != nullptr;
+    }
+};
+
+/**
+ * @brief Process-wide PoolMemoryResource, like std::pmr::new_delete_resource()
+ * @return Resource that is never destroyed, so static containers may use it
+ */
+inline PoolMemoryResource* poolMemoryResource() noexcept{
+    // 永不析构：静态析构阶段的 pmr 容器仍可能归还内存
+    alignas(PoolMemoryResource) static unsigned char storage[sizeof(PoolMemoryResource)];
+    static PoolMemoryResource* resource = new(storage) PoolMemoryResource();
+    return resource;
+}
+
+} // namespace ZPmemoryPool
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @file ZPglobalNew.cc
+ * @brief  Replacement of the global operator new/delete families with HashBucket
+ *
+ * Opt-in: link this file (the ZPMemoryPoolGlobalNew CMake target, or
+ * ZP_OVERRIDE_GLOBAL_NEW=ON) and every new expression in the program is
+ * served by the size-class pools, over-aligned ones included as long as
+ * some class is aligned enough. Requests above MAX_SLOT_SIZE and alignments
+ * above 4 KiB go to the system malloc; deletes find their way
+ * back through the PageMap, so mixing the two is safe.
+ *
+ * Bootstrap: the pools are constant-initialized and the PageMap only uses
+ * calloc, so operator new works before any dynamic initialization has run.
+ * Nothing on the pool paths calls operator new itself (blocks come from
+ * SystemBlockProvider), which rules out recursion. Pointers freed during
+ * static destruction stay valid because the pools are never destroyed;
+ * this file also turns off the exit-time trim (HashBucket::setReleaseAtExit).
+ */
+
+#include "ZPmemoryPool.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+using ZPmemoryPool::HashBucket;
+
+// 静态初始化阶段关闭退出时的归还：整个进程的堆都在内存池里，退出时逐个 block 整理没有意义
+const bool g_keep_pools_at_exit = (HashBucket::setReleaseAtExit(false), true);
+
+// 与标准要求一致：失败时反复调用 new_handler，直到成功或者没有 handler
+void* allocate(size_t size){
+    if(size == 0){
+        size = 1;
+    }
+    for(;;){
+        void* p = nullptr;
+        if(size <= MAX_SLOT_SIZE){
+            try{
+                p = HashBucket::useMemory(size);
+            }catch(const std::bad_alloc&){
+                p = nullptr;
+            }
+        }else{
+            p = std::malloc(size);
+        }
+        if(p != nullptr){
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr){
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* allocateAligned(size_t size, std::align_val_t align){
+    const size_t alignment = static_cast<size_t>(align);
+    if(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+        return allocate(size);
+    }
+    // 有足够对齐的 size class 时仍走内存池；不能调用 useMemory(size, align)，
+    // 它的回退路径就是本函数
+    const size_t index = ZPmemoryPool::SizeClass::index(size == 0 ? 1 : size, alignment);
+    if(index < MEMORY_POOL_NUM){
+        return allocate(ZPmemoryPool::SizeClass::size(index));
+    }
+    // aligned_alloc 要求大小是对齐值的整数倍
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if(size == 0){
+        size = alignment;
+    }
+    for(;;){
+        if(void* p = std::aligned_alloc(alignment, size)){
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr){
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void deallocate(void* p) noexcept{
+    if(p != nullptr && !HashBucket::tryFreeMemory(p)){
+        std::free(p);
+    }
+}
+
+void deallocateSized(void* p, size_t size) noexcept{
+    if(p == nullptr){
+        return;
+    }
+    if(size != 0 && size <= MAX_SLOT_SIZE){
+        // 带大小的 delete 直接定位 size class，省掉 PageMap 查询
+        HashBucket::freeMemory(p, size);
+        return;
+    }
+    deallocate(p);
+}
+
+} // namespace
+
+void* operator new(size_t size){ return allocate(size); }
+void* operator new[](size_t size){ return allocate(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    try{
+        return allocate(size);
+    }catch(...){
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    try{
+        return allocate(size);
+    }catch(...){
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size, std::align_val_t align){ return allocateAligned(size, align); }
+void* operator new[](size_t size, std::align_val_t align){ return allocateAligned(size, align); }
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept{
+    try{
+        return allocateAligned(size, align);
+    }catch(...){
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept{
+    try{
+        return allocateAligned(size, align);
+    }catch(...){
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept{ deallocate(p); }
+void operator delete[](void* p) noexcept{ deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ deallocate(p); }
+
+void operator delete(void* p, size_t size) noexcept{ deallocateSized(p, size); }
+void operator delete[](void* p, size_t size) noexcept{ deallocateSized(p, size); }
+
+// 对齐分配中小的那部分也走内存池，统一按地址反查
+void operator delete(void* p, std::align_val_t) noexcept{ deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept{ deallocate(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept{ deallocate(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept{ deallocate(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept{ deallocate(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept{ deallocate(p); }
@@ -1,60 +1,284 @@
 #include "ZPmemoryPool.h"
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <mutex>
+#include <new>
+#include <istream>
+#include <ostream>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <iostream>
+#include <thread>
+#include <utility>
+
+#include <sys/mman.h>
+
+#if ZP_ENABLE_NUMA
+#include <numa.h>
+#include <sched.h>
+#endif
 
 namespace ZPmemoryPool {
 
-MemoryPool::MemoryPool(size_t block_size)
-: block_size_(block_size), slot_size_(0), first_block_(nullptr), 
-  current_slot_(nullptr), free_list_(nullptr), last_slot_(nullptr)
+namespace {
+
+#if ZP_ENABLE_NUMA
+// 每个节点的 block 都从绑定到该节点的 provider 分配；必须定义在 g_pools 之前，析构得更晚
+template<size_t... N>
+struct NumaProviders{
+    NumaBlockProvider providers[sizeof...(N)] = { NumaBlockProvider(static_cast<int>(N))... };
+};
+
+template<size_t... N>
+NumaProviders<N...> makeNumaProviders(std::index_sequence<N...>);
+
+constinit decltype(makeNumaProviders(std::make_index_sequence<MAX_NUMA_NODES>())) g_numa_providers;
+
+constexpr BlockProvider* nodeProvider(size_t node){ return &g_numa_providers.providers[node]; }
+#else
+constexpr BlockProvider* nodeProvider(size_t){ return nullptr; }
+#endif
+
+// 每个节点有 ZP_POOL_SHARDS 组内存池；第 s 组（节点 s / ZP_POOL_SHARDS）是一个 pool set
+constexpr size_t kPoolSets = MAX_NUMA_NODES * ZP_POOL_SHARDS;
+
+// 编译期就确定每个池的槽大小：pool set s 的第 i 个池是 pools[s * MEMORY_POOL_NUM + i]，槽大小为 SizeClass::size(i)
+template<size_t... I>
+struct PoolTable{
+    MemoryPool pools[sizeof...(I)] = {
+        MemoryPool(SizeClass::size(I % MEMORY_POOL_NUM),
+                   HashBucket::defaultBlockSizePolicy(SizeClass::size(I % MEMORY_POOL_NUM)),
+                   FreeListPolicy::Locked, nodeProvider(I / (MEMORY_POOL_NUM * ZP_POOL_SHARDS)))...
+    };
+};
+
+template<size_t... I>
+PoolTable<I...> makePoolTable(std::index_sequence<I...>);
+
+// 进程退出时是否归还空闲的 block（见 HashBucket::setReleaseAtExit）
+constinit std::atomic<bool> g_release_at_exit{ZP_RELEASE_AT_EXIT != 0};
+
+// 进程退出时归还所有没有活跃槽的 block，返回归还的字节数
+size_t releaseIdleBlocks();
+
+// 包一层 union，内存池永不析构：静态析构阶段之后、以及退出时仍在运行的线程
+// 分配和释放的都还是有效的内存池。由 g_release_at_exit 决定退出时是否归还空闲 block
+template<typename T>
+struct ExitGuarded{
+    constexpr ExitGuarded() : value() {}
+    ~ExitGuarded(){
+        if(g_release_at_exit.load(std::memory_order_relaxed)){
+            releaseIdleBlocks();
+        }
+    }
+    union { T value; };
+};
+
+// 常量初始化，不需要 initMemoryPool()，也不存在静态初始化顺序问题
+constinit ExitGuarded<decltype(makePoolTable(std::make_index_sequence<kPoolSets * MEMORY_POOL_NUM>()))> g_pools;
+
+// 正在使用的 pool set 数：每个节点的分片依次排列
+int poolSets(){
+    return HashBucket::numaNodes() * ZP_POOL_SHARDS;
+}
+
+MemoryPool& poolAt(int set, int index){
+    return g_pools.value.pools[set * MEMORY_POOL_NUM + index];
+}
+
+// 内存池所属的 NUMA 节点；不是 HashBucket 的内存池时返回 -1
+int nodeOf(const MemoryPool* pool){
+    const MemoryPool* first = g_pools.value.pools;
+    if(pool < first || pool >= first + kPoolSets * MEMORY_POOL_NUM){
+        return -1;
+    }
+    return static_cast<int>((pool - first) / (MEMORY_POOL_NUM * ZP_POOL_SHARDS));
+}
+
+// 直接映射的大块：映射开头放一个 owner 为空的 BlockHeader，用户指针紧随其后，按 cache line 对齐
+constexpr size_t kMappedHeader = (sizeof(BlockHeader) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+size_t mappedLength(size_t size){
+    return (size + kMappedHeader + PageMap::kPageSize - 1) & ~(PageMap::kPageSize - 1);
+}
+
+BlockHeader* mappedHeader(void* ptr){
+    return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - kMappedHeader);
+}
+
+void* registerMapping(void* base, size_t length){
+    BlockHeader* header = new(base) BlockHeader(nullptr, nullptr, nullptr, length);
+    PageMap::set(base, length, header);
+    return static_cast<char*>(base) + kMappedHeader;
+}
+
+void* mapLarge(size_t size){
+    const size_t length = mappedLength(size);
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED){
+        throw std::bad_alloc();
+    }
+    return registerMapping(base, length);
+}
+
+void unmapLarge(void* ptr){
+    BlockHeader* header = mappedHeader(ptr);
+    const size_t length = header->size;
+    PageMap::clear(header, length);
+    munmap(header, length);
+}
+
+constinit std::atomic<int> g_next_shard{0};        // 轮流分给新线程的分片
+constinit thread_local int t_shard = -1;
+
+size_t releaseIdleBlocks(){
+    // 主线程的线程缓存此时已经析构并归还；其他线程缓存中的槽算作活跃，所在 block 保留
+#if ZP_PER_CPU_CACHE
+    CpuCache::flushAll();
+#endif
+    size_t released = 0;
+    for(int set = 0; set < poolSets(); set++){
+        for(int i = 0; i < MEMORY_POOL_NUM; i++){
+            released += poolAt(set, i).Trim();
+        }
+    }
+    return released;
+}
+
+} // namespace
+
+void Hardening::fail(const char* what, const void* ptr){
+    // 堆已经损坏：不再经过任何可能分配内存的路径，直接输出后终止
+    std::fprintf(stderr, "ZPmemoryPool: %s at %p\n", what, ptr);
+    std::abort();
+}
+
+std::uintptr_t Hardening::makeSecret(){
+    // 不用 std::random_device：它可能分配内存，而 operator new 可能已经被替换成内存池。
+    // 时钟加上栈和全局变量的地址（ASLR）足以让每次运行的编码不同，这里要防的是误写而不是攻击
+    std::uintptr_t seed = static_cast<std::uintptr_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    seed ^= reinterpret_cast<std::uintptr_t>(&seed) ^ std::rotl(reinterpret_cast<std::uintptr_t>(&secret_), 32);
+    // splitmix64 收尾，打散各个输入的低位
+    seed += 0x9E3779B97F4A7C15ull;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+    seed = (seed ^ (seed >> 31)) | 1;
+    std::uintptr_t expected = 0;
+    // 多个线程同时生成时以先写入的为准
+    return secret_.compare_exchange_strong(expected, seed, std::memory_order_relaxed) ? seed : expected;
+}
+
+MemoryPool::MemoryPool(size_t block_size, size_t max_block_size)
+: block_size_(block_size), initial_block_size_(block_size),
+  max_block_size_(max_block_size < block_size ? block_size : max_block_size), slot_size_(0),
+  policy_(FreeListPolicy::Locked), provider_(nullptr), free_list_(nullptr), tagged_free_list_(0), bins_{},
+  current_slot_(nullptr), last_slot_(nullptr), first_block_(nullptr)
 {};
 
 MemoryPool::~MemoryPool(){
     // delete the continuous block
-    Slot* cur = first_block_;
+    BlockHeader* cur = first_block_;
     while (cur) {
-        Slot* next = cur->next;
-        // 等同于 free(reinterpret_cast《void*》（first_block_）)
-        // 转化为void指针，因为void 类型不需要调用析构函数，只释放空间
-        operator delete(reinterpret_cast<void*>(cur)); // 释放整个Block，operator delete 释放整个分配块
+        BlockHeader* next = cur->next;
+        ReleaseBlock(cur); // 释放整个Block，交还给分配它的 BlockProvider
         cur = next;
     }
 };
 
-void MemoryPool::init(size_t size){
+void MemoryPool::init(size_t size, FreeListPolicy policy){
     assert(size>0);
+    std::lock_guard<std::mutex> block_lock(mutex_for_block_);
+    std::lock_guard<std::mutex> free_list_lock(mutex_for_free_list_);
+    if(first_block_ != nullptr){
+        // 已经持有内存：保留所有 block 与空闲槽，重复 init 不能丢弃已预热的内存
+        assert(size == slot_size_);
+        if(policy != policy_){
+            Slot* head = nullptr;
+            if(policy_ == FreeListPolicy::LockFree){
+                head = TaggedSlot(tagged_free_list_.exchange(0, std::memory_order_acquire));
+            }else if(policy_ == FreeListPolicy::PerBlock){
+                head = DrainPerBlock();
+            }else{
+                head = free_list_.exchange(nullptr, std::memory_order_relaxed);
+            }
+            policy_ = policy;
+            if(head != nullptr){
+                Slot* tail = head;
+                while(tail->getNext() != nullptr){
+                    tail = tail->getNext();
+                }
+                if(policy_ == FreeListPolicy::LockFree){
+                    PushLockFree(head, tail);
+                }else if(policy_ == FreeListPolicy::PerBlock){
+                    PushPerBlock(head, tail);
+                }else{
+                    tail->setNext(free_list_.load(std::memory_order_relaxed));
+                    free_list_.store(head, std::memory_order_relaxed);
+                }
+            }
+        }
+        return;
+    }
     slot_size_ = size;
+    policy_ = policy;
+    block_size_ = initial_block_size_;
     first_block_ = nullptr;
     current_slot_ = nullptr;
-    free_list_ = nullptr;
+    free_list_.store(nullptr, std::memory_order_relaxed);
+    tagged_free_list_.store(0, std::memory_order_relaxed);
     last_slot_ = nullptr;
 }
 
 void* MemoryPool::Allocate(){
     // 优先使用空闲链表中的内存槽
-    if(free_list_ != nullptr){
-        {
-            std::lock_guard<std::mutex> lock(mutex_for_free_list_);
-            if(free_list_ != nullptr){
-                Slot* temp = free_list_;
-                free_list_ = free_list_->next;
-                return temp;
-            }
+    if(policy_ == FreeListPolicy::LockFree){
+        if(Slot* slot = PopLockFree()){
+            PageMap::get(slot)->live.fetch_add(1, std::memory_order_relaxed);
+            CountAllocated(1, 1);
+            Hardening::onAllocate(slot, slot_size_);
+            return slot;
+        }
+    }else if(policy_ == FreeListPolicy::PerBlock){
+        CountedLock lock(mutex_for_free_list_, *this);
+        Slot* slot = nullptr;
+        Slot* tail = nullptr;
+        if(PopPerBlock(slot, tail, 1) != 0){
+            CountAllocated(1, 1);
+            Hardening::onAllocate(slot, slot_size_);
+            return slot;
+        }
+    }else if(free_list_.load(std::memory_order_relaxed) != nullptr){
+        // 无锁预检查只是提示，真正的判断在锁内进行
+        CountedLock lock(mutex_for_free_list_, *this);
+        Slot* temp = free_list_.load(std::memory_order_relaxed);
+        if(temp != nullptr){
+            free_list_.store(temp->getNext(), std::memory_order_relaxed);
+            // live 计数必须在锁内修改，Trim() 持有同一把锁
+            PageMap::get(temp)->live.fetch_add(1, std::memory_order_relaxed);
+            CountAllocated(1, 1);
+            Hardening::onAllocate(temp, slot_size_);
+            return temp;
         }
     }
 
     Slot* temp;
     {
-        std::lock_guard<std::mutex> lock(mutex_for_block_);
+        CountedLock lock(mutex_for_block_, *this);
         if(current_slot_ == nullptr || current_slot_ > last_slot_){
             // 当前memory block is 不可用，开辟新一块
             AllocateNewBlock();
         }
 
         temp = current_slot_;
+        Hardening::onCarve(temp, slot_size_);
+        first_block_->live.fetch_add(1, std::memory_order_relaxed);
+        CountAllocated(1, 0);
         // Move to next slot
         current_slot_ = reinterpret_cast<Slot*>(reinterpret_cast<char*>(current_slot_) + slot_size_);
     }
@@ -65,54 +289,1581 @@ void MemoryPool::Deallocate(void* ptr){
     if(ptr)
     {
         // hui shou memory, which is inserted free list by head insert method
-        std::lock_guard<std::mutex> lock(mutex_for_free_list_);
-        reinterpret_cast<Slot*>(ptr)->next = free_list_;
-        free_list_ = reinterpret_cast<Slot*>(ptr);
+        if constexpr (Hardening::kEnabled){
+            CheckSlot(ptr, this, slot_size_);
+        }
+        Hardening::onFree(ptr, slot_size_);
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        if(policy_ == FreeListPolicy::LockFree){
+            PageMap::get(slot)->live.fetch_sub(1, std::memory_order_relaxed);
+            PushLockFree(slot, slot);
+            CountFreed(1);
+            return;
+        }
+        CountedLock lock(mutex_for_free_list_, *this);
+        PageMap::get(slot)->live.fetch_sub(1, std::memory_order_relaxed);
+        CountFreed(1);
+        if(policy_ == FreeListPolicy::PerBlock){
+            PushPerBlock(slot, slot);
+            return;
+        }
+        slot->setNext(free_list_.load(std::memory_order_relaxed));
+        free_list_.store(slot, std::memory_order_relaxed);
+    }
+}
+
+void MemoryPool::AllocateBatch(void** out, size_t n){
+    if(n == 0){
+        return;
+    }
+    Slot* slot = nullptr;
+    FetchChain(slot, n);
+    for(size_t i = 0; i < n; ++i){
+        out[i] = slot;
+        slot = slot->getNext();
+        Hardening::onAllocate(out[i], slot_size_);
     }
 }
 
+void MemoryPool::DeallocateBatch(void** ptrs, size_t n){
+    // 先在锁外把所有槽串成一条链
+    Slot* head = nullptr;
+    Slot* tail = nullptr;
+    for(size_t i = 0; i < n; ++i){
+        Slot* slot = reinterpret_cast<Slot*>(ptrs[i]);
+        if(slot == nullptr){
+            continue;
+        }
+        if constexpr (Hardening::kEnabled){
+            CheckSlot(slot, this, slot_size_);
+        }
+        Hardening::onFree(slot, slot_size_);
+        if(tail){
+            tail->setNext(slot);
+        }else{
+            head = slot;
+        }
+        tail = slot;
+    }
+    ReleaseChain(head, tail);
+}
+
+size_t MemoryPool::TakeFree(Slot*& head, Slot*& tail, size_t n, bool wait){
+    head = nullptr;
+    tail = nullptr;
+    size_t count = 0;
+    if(policy_ == FreeListPolicy::LockFree){
+        // 无锁模式逐个弹出，每次 CAS 都会推进版本号
+        while(count < n){
+            Slot* slot = PopLockFree();
+            if(slot == nullptr){
+                break;
+            }
+            PageMap::get(slot)->live.fetch_add(1, std::memory_order_relaxed);
+            slot->setNext(nullptr);
+            if(tail){
+                tail->setNext(slot);
+            }else{
+                head = slot;
+            }
+            tail = slot;
+            ++count;
+        }
+        CountAllocated(count, count);
+    }else if(policy_ == FreeListPolicy::PerBlock){
+        auto take = [&]{
+            count = PopPerBlock(head, tail, n);
+            CountAllocated(count, count);
+        };
+        if(wait){
+            CountedLock lock(mutex_for_free_list_, *this);
+            take();
+        }else{
+            std::unique_lock<std::mutex> lock(mutex_for_free_list_, std::try_to_lock);
+            if(lock.owns_lock()){
+                take();
+            }
+        }
+    }else if(free_list_.load(std::memory_order_relaxed) != nullptr){
+        // 一次加锁从空闲链表摘下最多 n 个槽
+        auto unlink = [&]{
+            Slot* first = free_list_.load(std::memory_order_relaxed);
+            if(first != nullptr){
+                head = tail = first;
+                count = 1;
+                while(count < n && tail->getNext() != nullptr){
+                    tail = tail->getNext();
+                    ++count;
+                }
+                free_list_.store(tail->getNext(), std::memory_order_relaxed);
+                tail->setNext(nullptr);
+                AdjustLive(head, tail, true);
+                CountAllocated(count, count);
+            }
+        };
+        if(wait){
+            CountedLock lock(mutex_for_free_list_, *this);
+            unlink();
+        }else{
+            // 偷取方不排队：锁被占用说明那个分片正忙，不如去下一个
+            std::unique_lock<std::mutex> lock(mutex_for_free_list_, std::try_to_lock);
+            if(lock.owns_lock()){
+                unlink();
+            }
+        }
+    }
+    return count;
+}
+
+size_t MemoryPool::StealChain(Slot*& head, size_t n){
+    Slot* tail = nullptr;
+    return TakeFree(head, tail, n, false);
+}
+
+size_t MemoryPool::FetchChain(Slot*& head, size_t n, bool grow){
+    Slot* tail = nullptr;
+    size_t count = TakeFree(head, tail, n, true);
+
+    if(count < n){
+        // 不够的部分从当前 block 中连续切分
+        CountedLock lock(mutex_for_block_, *this);
+        const size_t reused = count;
+        for(; count < n; ++count){
+            if(current_slot_ == nullptr || current_slot_ > last_slot_){
+                if(!grow){
+                    break;
+                }
+                AllocateNewBlock();
+            }
+            Slot* slot = current_slot_;
+            current_slot_ = reinterpret_cast<Slot*>(reinterpret_cast<char*>(current_slot_) + slot_size_);
+            first_block_->live.fetch_add(1, std::memory_order_relaxed);
+            // 切分出的槽和空闲链表上的槽一样进入链表，由取走它的一方 onAllocate()
+            Hardening::markFree(slot, slot_size_);
+            slot->setNext(nullptr);
+            if(tail){
+                tail->setNext(slot);
+            }else{
+                head = slot;
+            }
+            tail = slot;
+        }
+        CountAllocated(count - reused, 0);
+    }
+    return count;
+}
+
+void MemoryPool::ReleaseToOwners(Slot* head, Slot* tail){
+    // 按所属内存池分段归还；相邻的槽大多来自同一个内存池，每段只加一次锁
+    tail->setNext(nullptr);
+    while(head != nullptr){
+        MemoryPool* owner = PageMap::get(head)->owner;
+        Slot* run_tail = head;
+        while(run_tail->getNext() != nullptr && PageMap::get(run_tail->getNext())->owner == owner){
+            run_tail = run_tail->getNext();
+        }
+        Slot* next = run_tail->getNext();
+        owner->ReleaseChain(head, run_tail);
+        head = next;
+    }
+}
+
+void MemoryPool::ReleaseChain(Slot* head, Slot* tail){
+    if(head == nullptr){
+        return;
+    }
+    if(policy_ == FreeListPolicy::LockFree){
+        size_t n = AdjustLive(head, tail, false);
+        PushLockFree(head, tail);
+        CountFreed(n);
+        return;
+    }
+    // 整条链头插进 free list
+    CountedLock lock(mutex_for_free_list_, *this);
+    CountFreed(AdjustLive(head, tail, false));
+    if(policy_ == FreeListPolicy::PerBlock){
+        PushPerBlock(head, tail);
+        return;
+    }
+    tail->setNext(free_list_.load(std::memory_order_relaxed));
+    free_list_.store(head, std::memory_order_relaxed);
+}
+
+size_t MemoryPool::PopPerBlock(Slot*& head, Slot*& tail, size_t n){
+    head = nullptr;
+    tail = nullptr;
+    size_t count = 0;
+    for(int bin = kFullnessBins - 1; bin >= 0 && count < n; ){
+        BlockHeader* block = bins_[bin];
+        if(block == nullptr){
+            --bin;
+            continue;
+        }
+        // 从最满的 block 连续取槽；取空后 Rebin() 把它移出分组
+        size_t taken = 0;
+        while(count < n && block->free != nullptr){
+            Slot* slot = block->free;
+            block->free = slot->getNext();
+            slot->setNext(nullptr);
+            if(tail){
+                tail->setNext(slot);
+            }else{
+                head = slot;
+            }
+            tail = slot;
+            ++taken;
+            ++count;
+        }
+        block->live.fetch_add(taken, std::memory_order_relaxed);
+        Rebin(block);
+    }
+    return count;
+}
+
+void MemoryPool::PushPerBlock(Slot* head, Slot* tail){
+    // 与 AdjustLive() 一样，相邻的槽通常属于同一个 block，每个 block 只调整一次分组
+    BlockHeader* block = nullptr;
+    for(Slot* slot = head; slot != nullptr; ){
+        Slot* next = slot == tail ? nullptr : slot->getNext();
+        char* p = reinterpret_cast<char*>(slot);
+        if(block == nullptr || p < reinterpret_cast<char*>(block) || p >= reinterpret_cast<char*>(block) + block->size){
+            if(block != nullptr){
+                Rebin(block);
+            }
+            block = PageMap::get(slot);
+        }
+        slot->setNext(block->free);
+        block->free = slot;
+        slot = next;
+    }
+    Rebin(block);
+}
+
+Slot* MemoryPool::DrainPerBlock(){
+    Slot* head = nullptr;
+    for(BlockHeader*& first : bins_){
+        while(BlockHeader* block = first){
+            Slot* tail = block->free;
+            while(tail->getNext() != nullptr){
+                tail = tail->getNext();
+            }
+            tail->setNext(head);
+            head = block->free;
+            block->free = nullptr;
+            UnlinkBin(block);
+        }
+    }
+    return head;
+}
+
+void MemoryPool::Rebin(BlockHeader* block){
+    int bin = BlockHeader::kNoBin;
+    if(block->free != nullptr){
+        // 按已交出的槽所占比例分组；live 可能在 block 锁下被切分路径并发修改，只影响分组的准确性
+        const size_t slots = SlotsInBlock(block);
+        const size_t live = std::min(block->live.load(std::memory_order_relaxed), slots);
+        bin = static_cast<int>(std::min<size_t>(live * kFullnessBins / slots, kFullnessBins - 1));
+    }
+    if(bin == block->bin){
+        return;
+    }
+    UnlinkBin(block);
+    if(bin != BlockHeader::kNoBin){
+        block->bin_next = bins_[bin];
+        if(block->bin_next != nullptr){
+            block->bin_next->bin_prev = block;
+        }
+        bins_[bin] = block;
+        block->bin = bin;
+    }
+}
+
+void MemoryPool::UnlinkBin(BlockHeader* block){
+    if(block->bin == BlockHeader::kNoBin){
+        return;
+    }
+    if(block->bin_prev != nullptr){
+        block->bin_prev->bin_next = block->bin_next;
+    }else{
+        bins_[block->bin] = block->bin_next;
+    }
+    if(block->bin_next != nullptr){
+        block->bin_next->bin_prev = block->bin_prev;
+    }
+    block->bin_prev = nullptr;
+    block->bin_next = nullptr;
+    block->bin = BlockHeader::kNoBin;
+}
+
+Slot* MemoryPool::PopLockFree(){
+    std::uint64_t old_head = tagged_free_list_.load(std::memory_order_acquire);
+    for(;;){
+        Slot* top = TaggedSlot(old_head);
+        if(top == nullptr){
+            return nullptr;
+        }
+        // 无锁模式下 Trim() 不归还 block，所以即使 top 已被别的线程弹出，读 next 也不会越界；
+        // 版本号保证这种情况下 CAS 必然失败
+        Slot* next = top->peekNext();
+        if(tagged_free_list_.compare_exchange_weak(old_head, MakeTagged(next, old_head),
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_acquire)){
+            return top;
+        }
+    }
+}
+
+void MemoryPool::PushLockFree(Slot* head, Slot* tail){
+    assert((reinterpret_cast<std::uintptr_t>(head) & ~kPointerMask) == 0);
+    std::uint64_t old_head = tagged_free_list_.load(std::memory_order_relaxed);
+    do{
+        tail->setNext(TaggedSlot(old_head));
+    }while(!tagged_free_list_.compare_exchange_weak(old_head, MakeTagged(head, old_head),
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+}
+
 void MemoryPool::AllocateNewBlock()
 {
     // std::cout << "申请一块内存，slotsize： "<< slot_size_ << std::endl;
     // head insert new memory block
-    void* new_block = operator new(block_size_);
-    reinterpret_cast<Slot*>(new_block)->next = first_block_;
-    first_block_ = reinterpret_cast<Slot*>(new_block);
+    // block 至少要放得下头部、对齐填充和一个槽，并且是整数个页
+    size_t size = block_size_;
+    if(size < sizeof(BlockHeader) + 2 * slot_size_){
+        size = sizeof(BlockHeader) + 2 * slot_size_;
+    }
+    size = (size + PageMap::kPageSize - 1) & ~(PageMap::kPageSize - 1);
+    // 几何增长：下一个 block 翻倍，直到上限
+    block_size_ = block_size_ > max_block_size_ / 2 ? max_block_size_ : block_size_ * 2;
+
+    // 按页对齐分配，这样每一页只属于一个 block，可以通过 PageMap 反查
+    BlockProvider& provider = blockProvider();
+    void* new_block = provider.allocate(size);
+    first_block_ = new(new_block) BlockHeader(first_block_, this, &provider, size);
+    PageMap::set(new_block, size, first_block_);
+    bytes_reserved_.fetch_add(size, std::memory_order_relaxed);
+#if ZP_ENABLE_STATS
+    stats_.blocks_allocated.fetch_add(1, std::memory_order_relaxed);
+#endif
 
-    char* body = reinterpret_cast<char*>(new_block) + sizeof(Slot*);
-    size_t padding_size = PadPointer(body, slot_size_);
+    char* body = reinterpret_cast<char*>(new_block) + sizeof(BlockHeader);
+    size_t padding_size = PadPointer(body, SlotAlignment(slot_size_));
     
     // Set current_slot_ to the beginning of usable memory (after padding)
     current_slot_ = reinterpret_cast<Slot*>(body + padding_size);
     
     // Set last_slot_ to the last possible slot in this block
-    char* block_end = reinterpret_cast<char*>(new_block) + block_size_;
+    char* block_end = reinterpret_cast<char*>(new_block) + size;
     last_slot_ = reinterpret_cast<Slot*>(block_end - slot_size_);
 }
 
+size_t MemoryPool::AdjustLive(Slot* head, Slot* tail, bool allocated){
+    // 链上相邻的槽通常来自同一个 block，先检查上一次查到的 header 以省掉 PageMap 查询
+    BlockHeader* block = nullptr;
+    size_t pending = 0;
+    size_t total = 0;
+    for(Slot* slot = head; ; slot = slot->getNext()){
+        char* p = reinterpret_cast<char*>(slot);
+        if(block == nullptr || p < reinterpret_cast<char*>(block) || p >= reinterpret_cast<char*>(block) + block->size){
+            if(block != nullptr){
+                allocated ? block->live.fetch_add(pending, std::memory_order_relaxed)
+                          : block->live.fetch_sub(pending, std::memory_order_relaxed);
+            }
+            block = PageMap::get(slot);
+            pending = 0;
+        }
+        ++pending;
+        ++total;
+        if(slot == tail){
+            break;
+        }
+    }
+    allocated ? block->live.fetch_add(pending, std::memory_order_relaxed)
+              : block->live.fetch_sub(pending, std::memory_order_relaxed);
+    return total;
+}
+
+void MemoryPool::ReleaseBlock(BlockHeader* block){
+    size_t size = block->size;
+    BlockProvider* provider = block->provider;
+    PageMap::clear(block, size);
+    block->~BlockHeader();
+    // 空闲槽可能还处于 ASan 投毒状态，交还 provider 之前整块恢复
+    Hardening::releaseRange(block, size);
+    provider->deallocate(block, size);
+}
+
+void MemoryPool::CheckSlot(const void* ptr, const MemoryPool* pool, size_t slot_size){
+    BlockHeader* block = PageMap::get(ptr);
+    if(block == nullptr){
+        Hardening::fail("free of a pointer that is not in any pool block", ptr);
+    }
+    if(pool != nullptr ? block->owner != pool : block->owner->slot_size_ != slot_size){
+        Hardening::fail("free to the wrong pool or with the wrong size", ptr);
+    }
+    // 必须落在槽的网格上：第一个槽之后、整数个槽的位置
+    const char* body = reinterpret_cast<const char*>(block) + sizeof(BlockHeader);
+    const char* first = body + (SlotAlignment(slot_size) - reinterpret_cast<std::uintptr_t>(body)) % SlotAlignment(slot_size);
+    const char* p = static_cast<const char*>(ptr);
+    if(p < first || p + slot_size > reinterpret_cast<const char*>(block) + block->size
+       || static_cast<size_t>(p - first) % slot_size != 0){
+        Hardening::fail("free of a pointer that does not start a slot", ptr);
+    }
+}
+
+size_t MemoryPool::SlotsInBlock(BlockHeader* block){
+    char* body = reinterpret_cast<char*>(block) + sizeof(BlockHeader);
+    size_t usable = block->size - sizeof(BlockHeader) - PadPointer(body, SlotAlignment(slot_size_));
+    return usable / slot_size_;
+}
+
+void MemoryPool::CarveRemainder(){
+    if(current_slot_ == nullptr || current_slot_ > last_slot_){
+        return;
+    }
+    // 把当前 block 中还没切分的部分串成一条链，整条挂到空闲链表上
+    // last_slot_ 不一定落在槽的网格上，只有不超过它的位置才是完整的槽
+    Slot* head = current_slot_;
+    Slot* tail = head;
+    size_t n = 1;
+    Hardening::markFree(head, slot_size_);
+    for(Slot* next = reinterpret_cast<Slot*>(reinterpret_cast<char*>(tail) + slot_size_); next <= last_slot_;
+        next = reinterpret_cast<Slot*>(reinterpret_cast<char*>(next) + slot_size_)){
+        Hardening::markFree(next, slot_size_);
+        tail->setNext(next);
+        tail = next;
+        ++n;
+    }
+    current_slot_ = reinterpret_cast<Slot*>(reinterpret_cast<char*>(tail) + slot_size_);
+    if(policy_ == FreeListPolicy::LockFree){
+        PushLockFree(head, tail);
+    }else if(policy_ == FreeListPolicy::PerBlock){
+        std::lock_guard<std::mutex> lock(mutex_for_free_list_);
+        PushPerBlock(head, tail);
+    }else{
+        std::lock_guard<std::mutex> lock(mutex_for_free_list_);
+        tail->setNext(free_list_.load(std::memory_order_relaxed));
+        free_list_.store(head, std::memory_order_relaxed);
+    }
+    CountCarved(n);
+}
+
+size_t MemoryPool::Reserve(size_t n_slots){
+    assert(slot_size_ > 0);
+    std::lock_guard<std::mutex> block_lock(mutex_for_block_);
+    size_t capacity = 0;
+    for(BlockHeader* block = first_block_; block != nullptr; block = block->next){
+        capacity += SlotsInBlock(block);
+    }
+    if(current_slot_ != nullptr && current_slot_ <= last_slot_){
+        // 当前 block 中未切分的部分也可能还没有缺过页；首个不完整的页里已有槽在使用，跳过
+        // （Trim() 回收了当前 block 之后两者都是 nullptr）
+        std::uintptr_t start = reinterpret_cast<std::uintptr_t>(current_slot_);
+        start = (start + PageMap::kPageSize - 1) & ~(std::uintptr_t(PageMap::kPageSize) - 1);
+        std::uintptr_t end = reinterpret_cast<std::uintptr_t>(first_block_) + first_block_->size;
+        if(start < end){
+            first_block_->provider->prefault(reinterpret_cast<void*>(start), end - start);
+        }
+    }
+
+    size_t added = 0;
+    while(capacity < n_slots){
+        CarveRemainder();
+        AllocateNewBlock();
+        // 新 block 除了头部所在的第一页全部预先缺页
+        first_block_->provider->prefault(reinterpret_cast<char*>(first_block_) + PageMap::kPageSize,
+                                         first_block_->size - PageMap::kPageSize);
+        const size_t slots = SlotsInBlock(first_block_);
+        capacity += slots;
+        added += slots;
+    }
+    return added;
+}
+
+size_t MemoryPool::Trim(){
+    if(policy_ == FreeListPolicy::LockFree){
+        return 0;
+    }
+    std::lock_guard<std::mutex> block_lock(mutex_for_block_);
+    std::lock_guard<std::mutex> free_list_lock(mutex_for_free_list_);
+
+    // 1. 标记没有活跃槽的 block
+    size_t candidates = 0;
+    for(BlockHeader* block = first_block_; block != nullptr; block = block->next){
+        block->reclaim = block->live.load(std::memory_order_relaxed) == 0;
+        candidates += block->reclaim ? 1 : 0;
+    }
+    if(candidates == 0){
+        return 0;
+    }
+
+    // 2. 从空闲链表中摘掉这些 block 里的槽；PerBlock 模式下它们本来就在各自 block 的链表上
+    Slot* kept = nullptr;
+    Slot* kept_tail = nullptr;
+    size_t removed = 0;
+    if(policy_ == FreeListPolicy::PerBlock){
+        for(BlockHeader* block = first_block_; block != nullptr; block = block->next){
+            if(block->reclaim){
+                for(Slot* slot = block->free; slot != nullptr; slot = slot->getNext()){
+                    ++removed;
+                }
+                block->free = nullptr;
+                UnlinkBin(block);
+            }
+        }
+    }
+    for(Slot* slot = free_list_.load(std::memory_order_relaxed); slot != nullptr; ){
+        Slot* next = slot->getNext();
+        if(!PageMap::get(slot)->reclaim){
+            if(kept_tail){
+                kept_tail->setNext(slot);
+            }else{
+                kept = slot;
+            }
+            kept_tail = slot;
+        }else{
+            ++removed;
+        }
+        slot = next;
+    }
+    if(kept_tail){
+        kept_tail->setNext(nullptr);
+    }
+    free_list_.store(kept, std::memory_order_relaxed);
+#if ZP_ENABLE_STATS
+    stats_.free_slots.fetch_sub(removed, std::memory_order_relaxed);
+#else
+    (void)removed;
+#endif
+
+    // 3. 当前正在切分的 block 也被回收时，下次分配重新开辟
+    if(first_block_->reclaim){
+        current_slot_ = nullptr;
+        last_slot_ = nullptr;
+    }
+
+    // 4. 从 block 链表中摘除并归还
+    size_t released = 0;
+    BlockHeader** block_link = &first_block_;
+    while(*block_link != nullptr){
+        BlockHeader* block = *block_link;
+        if(block->reclaim){
+            *block_link = block->next;
+            released += block->size;
+            ReleaseBlock(block);
+        }else{
+            block_link = &block->next;
+        }
+    }
+    bytes_reserved_.fetch_sub(released, std::memory_order_relaxed);
+    return released;
+}
+
+PoolStats MemoryPool::stats() const{
+    PoolStats result;
+    result.slot_size = slot_size_;
+    result.bytes_reserved = bytes_reserved_.load(std::memory_order_relaxed);
+#if ZP_ENABLE_STATS
+    result.allocations = stats_.allocations.load(std::memory_order_relaxed);
+    result.frees = stats_.frees.load(std::memory_order_relaxed);
+    result.blocks_allocated = stats_.blocks_allocated.load(std::memory_order_relaxed);
+    result.lock_contention = stats_.lock_contention.load(std::memory_order_relaxed);
+    result.free_list_length = stats_.free_slots.load(std::memory_order_relaxed);
+    result.free_list_high_water = stats_.free_slots_high_water.load(std::memory_order_relaxed);
+    // 先读 frees 再读 allocations 时两者可能不一致，防止出现负数
+    result.bytes_live = result.allocations > result.frees
+                      ? static_cast<size_t>(result.allocations - result.frees) * slot_size_ : 0;
+#endif
+    return result;
+}
+
+FragmentationStats MemoryPool::fragmentation(){
+    FragmentationStats result;
+    result.slot_size = slot_size_;
+    // block 链表只在持有 block 锁时修改（Trim() 同时持有两把锁）
+    std::lock_guard<std::mutex> block_lock(mutex_for_block_);
+    for(BlockHeader* block = first_block_; block != nullptr; block = block->next){
+        char* body = reinterpret_cast<char*>(block) + sizeof(BlockHeader);
+        const size_t overhead = sizeof(BlockHeader) + PadPointer(body, SlotAlignment(slot_size_));
+        const size_t slots = SlotsInBlock(block);
+        ++result.blocks;
+        result.bytes_reserved += block->size;
+        result.block_overhead += overhead;
+        result.tail_waste += block->size - overhead - slots * slot_size_;
+        result.slots_total += slots;
+        result.slots_live += block->live.load(std::memory_order_relaxed);
+    }
+    if(current_slot_ != nullptr && current_slot_ <= last_slot_){
+        result.slots_uncarved = static_cast<size_t>(reinterpret_cast<char*>(last_slot_) - reinterpret_cast<char*>(current_slot_)) / slot_size_ + 1;
+    }
+    // 其余的槽都在空闲链表上；live 是无锁读的，负载下可能短暂偏大
+    const size_t used = result.slots_live + result.slots_uncarved;
+    result.slots_free = result.slots_total > used ? result.slots_total - used : 0;
+#if ZP_ENABLE_STATS
+    result.requests = stats_.requests.load(std::memory_order_relaxed);
+    result.bytes_requested = stats_.bytes_requested.load(std::memory_order_relaxed);
+    result.bytes_handed_out = result.requests * slot_size_;
+#endif
+    return result;
+}
+
+void MemoryPool::setBlockSizePolicy(const BlockSizePolicy& policy){
+    std::lock_guard<std::mutex> lock(mutex_for_block_);
+    initial_block_size_ = policy.initial_size;
+    max_block_size_ = policy.max_size < policy.initial_size ? policy.initial_size : policy.max_size;
+    block_size_ = initial_block_size_;
+}
+
+void MemoryPool::setBlockProvider(BlockProvider* provider){
+    std::lock_guard<std::mutex> lock(mutex_for_block_);
+    provider_ = provider;
+}
+
+size_t MemoryPool::SlotAlignment(size_t slot_size)
+{
+    // 槽大小能整除的最大 2 的幂；起始地址按它对齐后，后续每个槽都保持同样的对齐
+    size_t align = slot_size & (~slot_size + 1);
+    return align > kMaxSlotAlignment ? kMaxSlotAlignment : align;
+}
+
 size_t MemoryPool::PadPointer(char* p, size_t align)
-{// 让pointer 对齐到槽大小的数倍
-    // align  == slot_size
+{// 让pointer 对齐到 align 的倍数
     return (align - reinterpret_cast<size_t>(p)) % align;
     // 一个槽包括了一个指针
 }
 
-void HashBucket::initMemoryPool(){
-    for(int i = 0; i < MEMORY_POOL_NUM; i++){
-        getMemoryPool(i).init((i+1) * SLOT_BASE_SIZE);
-        // 0-->8;1-->16;...8-->64... 
+void HashBucket::initMemoryPool(FreeListPolicy policy, BlockSizePolicy (*block_policy)(size_t slot_size)){
+    for(int set = 0; set < poolSets(); set++){
+        for(int i = 0; i < MEMORY_POOL_NUM; i++){
+            size_t slot_size = SizeClass::size(i);
+            poolAt(set, i).setBlockSizePolicy(block_policy(slot_size));
+            poolAt(set, i).init(slot_size, policy);
+            // 0-->8;1-->16;...8-->64... 
+        }
     }
 }
 
 // 单例模式
 MemoryPool& HashBucket::getMemoryPool(int index){
+    return getMemoryPool(index, currentNumaNode(), currentShard());
+}
+
+MemoryPool& HashBucket::getMemoryPool(int index, int node){
+    return getMemoryPool(index, node, currentShard());
+}
+
+MemoryPool& HashBucket::getMemoryPool(int index, int node, int shard){
     if(index < 0 || index >= MEMORY_POOL_NUM)
     {
         throw std::out_of_range("MemoryPool index out of range");
     }
-    static MemoryPool pools[MEMORY_POOL_NUM];
-    return pools[index];
+    if(node < 0 || node >= numaNodes())
+    {
+        throw std::out_of_range("NUMA node out of range");
+    }
+    if(shard < 0 || shard >= ZP_POOL_SHARDS)
+    {
+        throw std::out_of_range("pool shard out of range");
+    }
+    return poolAt(node * ZP_POOL_SHARDS + shard, index);
+}
+
+int HashBucket::currentShard(){
+    if constexpr (ZP_POOL_SHARDS == 1){
+        return 0;
+    }
+    // 按线程而不是按 CPU 分片：线程迁移后仍使用同一组内存池，getMemoryPool() 的结果保持稳定
+    if(t_shard < 0){
+        t_shard = g_next_shard.fetch_add(1, std::memory_order_relaxed) % ZP_POOL_SHARDS;
+    }
+    return t_shard;
+}
+
+int HashBucket::numaNodes(){
+#if ZP_ENABLE_NUMA
+    // 超过 MAX_NUMA_NODES 的节点按取模共用内存池
+    static const int nodes = numa_available() < 0 ? 1 : std::clamp(numa_max_node() + 1, 1, MAX_NUMA_NODES);
+    return nodes;
+#else
+    return 1;
+#endif
+}
+
+int HashBucket::currentNumaNode(){
+#if ZP_ENABLE_NUMA
+    // getcpu 走 vDSO，不陷入内核
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(numaNodes() == 1 || getcpu(&cpu, &node) != 0){
+        return 0;
+    }
+    return static_cast<int>(node % static_cast<unsigned>(numaNodes()));
+#else
+    return 0;
+#endif
+}
+
+void HashBucket::freeMemory(void* ptr){
+    if(ptr && !tryFreeMemory(ptr)){
+        // 不在任何 block 中：operator new 分配的大块（MAX_SLOT_SIZE 到 kMapThreshold 之间）
+        if(HeapProfiler::active()){
+            HeapProfiler::onFree(ptr);
+        }
+        operator delete(ptr);
+    }
+}
+
+bool HashBucket::tryFreeMemory(void* ptr){
+    BlockHeader* block = PageMap::get(ptr);
+    if(block == nullptr){
+        return false;
+    }
+    MemoryPool* owner = block->owner;
+    if(owner == nullptr){
+        // useMemory() 直接映射的大块
+        if(HeapProfiler::active()){
+            HeapProfiler::onFree(ptr);
+        }
+        unmapLarge(ptr);
+        return true;
+    }
+    if(nodeOf(owner) >= 0){
+        // HashBucket 的内存池：在表中的位置就是 size class
+        if(HeapProfiler::active()){
+            HeapProfiler::onFree(ptr);
+        }
+        cachedDeallocate(ptr, static_cast<size_t>(owner - g_pools.value.pools) % MEMORY_POOL_NUM);
+        return true;
+    }
+    owner->Deallocate(ptr);
+    return true;
+}
+
+void* HashBucket::allocateLarge(size_t size){
+    return size >= kMapThreshold ? mapLarge(size) : operator new(size);
+}
+
+void HashBucket::freeLarge(void* ptr, size_t size){
+    if(size >= kMapThreshold){
+        unmapLarge(ptr);
+        return;
+    }
+    operator delete(ptr);
+}
+
+void* HashBucket::reallocMemory(void* ptr, size_t old_size, size_t new_size){
+    if(ptr == nullptr){
+        return useMemory(new_size);
+    }
+    if(new_size == 0){
+        freeMemory(ptr, old_size);
+        return nullptr;
+    }
+    if(old_size <= MAX_SLOT_SIZE && new_size <= MAX_SLOT_SIZE && SizeClass::index(old_size) == SizeClass::index(new_size)){
+        // 同一个 size class：槽本来就放得下
+        return ptr;
+    }
+    if(old_size >= kMapThreshold && new_size >= kMapThreshold){
+        BlockHeader* header = mappedHeader(ptr);
+        const size_t old_length = header->size;
+        const size_t new_length = mappedLength(new_size);
+        if(new_length == old_length){
+            return ptr;
+        }
+        // 由内核搬移页表，不拷贝数据；映射可能换了地址，PageMap 先清旧范围再登记新范围
+        void* base = mremap(header, old_length, new_length, MREMAP_MAYMOVE);
+        if(base == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+        if(HeapProfiler::active()){
+            HeapProfiler::onFree(ptr);
+        }
+        if(base == header && new_length > old_length){
+            PageMap::set(static_cast<char*>(base) + old_length, new_length - old_length, header);
+        }else if(base == header){
+            PageMap::clear(static_cast<char*>(base) + new_length, old_length - new_length);
+        }else{
+            PageMap::clear(header, old_length);
+            PageMap::set(base, new_length, static_cast<BlockHeader*>(base));
+        }
+        static_cast<BlockHeader*>(base)->size = new_length;
+        return sampled(static_cast<char*>(base) + kMappedHeader, new_size, MEMORY_POOL_NUM);
+    }
+    // 换 size class，或跨越 MAX_SLOT_SIZE / kMapThreshold：分配新内存并拷贝一次
+    void* result = useMemory(new_size);
+    std::memcpy(result, ptr, std::min(old_size, new_size));
+    freeMemory(ptr, old_size);
+    return result;
+}
+
+void HashBucket::setReleaseAtExit(bool release){
+    g_release_at_exit.store(release, std::memory_order_relaxed);
+}
+
+bool HashBucket::releaseAtExit(){
+    return g_release_at_exit.load(std::memory_order_relaxed);
+}
+
+void HashBucket::useMemoryBatch(size_t size, void** out, size_t n){
+    if(size == 0){
+        for(size_t i = 0; i < n; ++i){
+            out[i] = nullptr;
+        }
+        return;
+    }
+    size_t index = MEMORY_POOL_NUM;
+    if(size > MAX_SLOT_SIZE){
+        for(size_t i = 0; i < n; ++i){
+            out[i] = allocateLarge(size);
+        }
+    }else{
+        index = SizeClass::index(size);
+#if ZP_PER_CPU_CACHE
+        if(const int cpu = CpuCache::currentCpu(); cpu >= 0){
+            CpuCache::allocateBatch(cpu, index, out, n, size);
+        }else
+#endif
+        ThreadCache::local().allocateBatch(index, out, n, size);
+    }
+    if(HeapProfiler::active()){
+        for(size_t i = 0; i < n; ++i){
+            HeapProfiler::onAllocate(out[i], size, index);
+        }
+    }
+}
+
+void HashBucket::freeMemoryBatch(void** ptrs, size_t size, size_t n){
+    if(size == 0 || n == 0){
+        // useMemoryBatch(0, ...) 只会产生 nullptr
+        return;
+    }
+    if(HeapProfiler::active()){
+        for(size_t i = 0; i < n; ++i){
+            if(ptrs[i] != nullptr){
+                HeapProfiler::onFree(ptrs[i]);
+            }
+        }
+    }
+    if(size > MAX_SLOT_SIZE){
+        for(size_t i = 0; i < n; ++i){
+            if(ptrs[i] != nullptr){
+                freeLarge(ptrs[i], size);
+            }
+        }
+        return;
+    }
+#if ZP_PER_CPU_CACHE
+    if(const int cpu = CpuCache::currentCpu(); cpu >= 0){
+        CpuCache::deallocateBatch(cpu, SizeClass::index(size), ptrs, n);
+        return;
+    }
+#endif
+    ThreadCache::local().deallocateBatch(SizeClass::index(size), ptrs, n);
+}
+
+std::array<PoolStats, MEMORY_POOL_NUM> HashBucket::snapshotStats(){
+    std::array<PoolStats, MEMORY_POOL_NUM> result;
+    for(int i = 0; i < MEMORY_POOL_NUM; i++){
+        result[i] = poolAt(0, i).stats();
+        for(int set = 1; set < poolSets(); set++){
+            // 各节点、各分片同一档位的计数直接相加，高水位取最大值
+            PoolStats st = poolAt(set, i).stats();
+            result[i].allocations += st.allocations;
+            result[i].frees += st.frees;
+            result[i].blocks_allocated += st.blocks_allocated;
+            result[i].bytes_reserved += st.bytes_reserved;
+            result[i].bytes_live += st.bytes_live;
+            result[i].free_list_length += st.free_list_length;
+            result[i].free_list_high_water = std::max(result[i].free_list_high_water, st.free_list_high_water);
+            result[i].lock_contention += st.lock_contention;
+        }
+    }
+    return result;
+}
+
+void HashBucket::dumpStats(std::ostream& os){
+    os << "slot_size allocations frees blocks bytes_reserved bytes_live free_list free_list_hwm contention\n";
+    for(const PoolStats& st : snapshotStats()){
+        if(st.bytes_reserved == 0 && st.allocations == 0){
+            continue;
+        }
+        os << st.slot_size << ' ' << st.allocations << ' ' << st.frees << ' ' << st.blocks_allocated << ' '
+           << st.bytes_reserved << ' ' << st.bytes_live << ' ' << st.free_list_length << ' '
+           << st.free_list_high_water << ' ' << st.lock_contention << '\n';
+    }
+}
+
+std::array<FragmentationStats, MEMORY_POOL_NUM> HashBucket::fragmentationReport(){
+    ThreadCache::local().publishRequests();
+#if ZP_PER_CPU_CACHE
+    CpuCache::publishRequests();
+#endif
+    std::array<FragmentationStats, MEMORY_POOL_NUM> result;
+    for(int i = 0; i < MEMORY_POOL_NUM; i++){
+        result[i] = poolAt(0, i).fragmentation();
+        for(int set = 1; set < poolSets(); set++){
+            result[i] += poolAt(set, i).fragmentation();
+        }
+    }
+    return result;
+}
+
+void HashBucket::dumpFragmentation(std::ostream& os){
+    os << "slot_size blocks bytes_reserved overhead tail_waste slots live free uncarved requests bytes_requested internal_waste waste%\n";
+    auto print = [&os](const std::string& label, const FragmentationStats& st){
+        // 浪费率 = 取整浪费 / 交出去的字节数，保留一位小数
+        const std::uint64_t permille = st.bytes_handed_out != 0 ? st.internalWaste() * 1000 / st.bytes_handed_out : 0;
+        os << label << ' ' << st.blocks << ' ' << st.bytes_reserved << ' ' << st.block_overhead << ' '
+           << st.tail_waste << ' ' << st.slots_total << ' ' << st.slots_live << ' ' << st.slots_free << ' '
+           << st.slots_uncarved << ' ' << st.requests << ' ' << st.bytes_requested << ' ' << st.internalWaste() << ' '
+           << permille / 10 << '.' << permille % 10 << '\n';
+    };
+    FragmentationStats total;
+    for(const FragmentationStats& st : fragmentationReport()){
+        if(st.blocks == 0 && st.requests == 0){
+            continue;
+        }
+        print(std::to_string(st.slot_size), st);
+        total += st;
+    }
+    print("total", total);
+}
+
+std::array<PoolStats, MEMORY_POOL_NUM> HashBucket::parseStats(std::istream& is){
+    std::array<PoolStats, MEMORY_POOL_NUM> result;
+    for(int i = 0; i < MEMORY_POOL_NUM; i++){
+        result[i].slot_size = SizeClass::size(i);
+    }
+    std::string line;
+    std::getline(is, line); // 表头
+    while(std::getline(is, line)){
+        std::istringstream fields(line);
+        PoolStats st;
+        if(!(fields >> st.slot_size >> st.allocations >> st.frees >> st.blocks_allocated >> st.bytes_reserved
+                    >> st.bytes_live >> st.free_list_length >> st.free_list_high_water >> st.lock_contention)){
+            continue;
+        }
+        // 只接受与本程序 size class 表一致的行
+        if(st.slot_size == 0 || st.slot_size > MAX_SLOT_SIZE || SizeClass::size(SizeClass::index(st.slot_size)) != st.slot_size){
+            continue;
+        }
+        result[SizeClass::index(st.slot_size)] = st;
+    }
+    return result;
+}
+
+size_t HashBucket::warmup(const std::array<PoolStats, MEMORY_POOL_NUM>& profile){
+    std::array<size_t, MEMORY_POOL_NUM> slots{};
+    for(int i = 0; i < MEMORY_POOL_NUM; i++){
+        const PoolStats& st = profile[i];
+        if(st.slot_size == 0){
+            continue;
+        }
+        // 曾经切分出来的槽 = 仍在使用的 + 空闲链表上的；没有统计计数时按持有的字节数估算
+        slots[i] = st.allocations != 0 ? st.bytes_live / st.slot_size + st.free_list_length
+                                       : st.bytes_reserved / st.slot_size;
+    }
+    return warmup(slots);
+}
+
+size_t HashBucket::warmup(const std::array<size_t, MEMORY_POOL_NUM>& slots){
+    size_t added = 0;
+    for(int i = 0; i < MEMORY_POOL_NUM; i++){
+        if(slots[i] != 0){
+            added += getMemoryPool(i).Reserve(slots[i]);
+        }
+    }
+    return added;
+}
+
+size_t HashBucket::trimAll(){
+    ThreadCache::local().flushAll();
+    return releaseIdleBlocks();
+}
+
+void HashBucket::setBlockProvider(BlockProvider* provider){
+    for(int set = 0; set < poolSets(); set++){
+        for(int i = 0; i < MEMORY_POOL_NUM; i++){
+            poolAt(set, i).setBlockProvider(provider != nullptr ? provider : nodeProvider(set / ZP_POOL_SHARDS));
+        }
+    }
+}
+
+namespace {
+
+// 后台定期调用 trimAll() 的线程
+class BackgroundTrimmer{
+public:
+    ~BackgroundTrimmer(){ stop(); }
+
+    void start(std::chrono::milliseconds interval){
+        std::lock_guard<std::mutex> lock(mutex_);
+        interval_ = interval;
+        if(!thread_.joinable()){
+            stopping_ = false;
+            thread_ = std::thread(&BackgroundTrimmer::run, this);
+        }
+        cv_.notify_all();
+    }
+
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if(thread_.joinable()){
+            thread_.join();
+        }
+    }
+
+private:
+    void run(){
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(!stopping_){
+            if(cv_.wait_for(lock, interval_, [this]{ return stopping_; })){
+                break;
+            }
+            lock.unlock();
+            HashBucket::trimAll();
+            lock.lock();
+        }
+    }
+
+    std::mutex                  mutex_;
+    std::condition_variable     cv_;
+    std::thread                 thread_;
+    std::chrono::milliseconds   interval_{0};
+    bool                        stopping_ = false;
+};
+
+BackgroundTrimmer& backgroundTrimmer(){
+    static BackgroundTrimmer trimmer;
+    return trimmer;
+}
+
+} // namespace
+
+void HashBucket::startBackgroundTrim(std::chrono::milliseconds interval){
+    backgroundTrimmer().start(interval);
+}
+
+void HashBucket::stopBackgroundTrim(){
+    backgroundTrimmer().stop();
+}
+
+#if ZP_ENABLE_REMOTE_FREE
+// 线程堆：其他线程释放回本线程的槽按 size class 排成 MPSC 链表。
+// 记录永不释放，线程退出后交给新线程复用：别的线程可能还拿着旧指针 push，
+// 这样不会访问已释放的内存，退出之后才 push 进来的槽由接手的线程取走。
+struct ThreadHeap{
+    std::atomic<Slot*>  remote[MEMORY_POOL_NUM]{};  // 其他线程 CAS push，所属线程 exchange 整条取走
+    std::atomic<bool>   alive{false};               // 是否有线程正在使用
+    ThreadHeap*         next = nullptr;             // 全局登记链表
+};
+
+namespace {
+
+constinit std::atomic<ThreadHeap*> g_heaps{nullptr};
+
+// 线程退出时放进自己每条队列的标记：看到它的线程不再 push，槽留在自己的缓存里
+Slot* closedQueue(){
+    return reinterpret_cast<Slot*>(std::uintptr_t{1});
+}
+
+ThreadHeap* acquireHeap(){
+    for(ThreadHeap* heap = g_heaps.load(std::memory_order_acquire); heap != nullptr; heap = heap->next){
+        bool expected = false;
+        if(!heap->alive.load(std::memory_order_relaxed)
+           && heap->alive.compare_exchange_strong(expected, true, std::memory_order_acq_rel)){
+            // 上一个线程关闭了所有队列，重新打开
+            for(std::atomic<Slot*>& queue : heap->remote){
+                queue.store(nullptr, std::memory_order_release);
+            }
+            return heap;
+        }
+    }
+    // 不能用 operator new：它可能已被替换成 HashBucket，而线程缓存此刻正在构造
+    void* raw = std::calloc(1, sizeof(ThreadHeap));
+    if(raw == nullptr){
+        return nullptr; // 没有线程堆只是不做跨线程归还
+    }
+    ThreadHeap* heap = new(raw) ThreadHeap();
+    heap->alive.store(true, std::memory_order_relaxed);
+    heap->next = g_heaps.load(std::memory_order_relaxed);
+    while(!g_heaps.compare_exchange_weak(heap->next, heap, std::memory_order_release, std::memory_order_relaxed)){}
+    return heap;
+}
+
+} // namespace
+#endif
+
+ThreadCache::ThreadCache()
+: node_(HashBucket::currentNumaNode())
+, shard_(HashBucket::currentShard())
+#if ZP_ENABLE_NUMA
+, numa_(HashBucket::numaNodes() > 1)
+#endif
+#if ZP_ENABLE_REMOTE_FREE
+, heap_(acquireHeap())
+#endif
+{}
+
+ThreadCache::~ThreadCache(){
+#if ZP_ENABLE_REMOTE_FREE
+    if(heap_ != nullptr){
+        // 先关闭队列并取走最后一批槽：检查过 alive 但还没 push 的线程会看到关闭标记，
+        // 槽留在它们自己的缓存里，不会滞留在没有主人的线程堆中。
+        // 关闭之后才清 alive，接手这个线程堆的新线程看到的一定是已关闭的队列
+        for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+            takeRemote(i, heap_->remote[i].exchange(closedQueue(), std::memory_order_acquire));
+        }
+        heap_->alive.store(false, std::memory_order_release);
+        heap_ = nullptr;
+    }
+#endif
+    flushAll();
+    // 之后同一线程里其他 thread_local 的析构仍可能分配/释放：
+    // 把长度设成极大值，deallocate() 每次都会立刻 flush，refill() 也只取一个槽
+    for(FreeList& list : lists_){
+        list.length = kTornDown;
+    }
+}
+
+void ThreadCache::flushAll(){
+#if ZP_ENABLE_REMOTE_FREE
+    if(heap_ != nullptr){
+        for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+            drainRemote(i);
+        }
+    }
+#endif
+    for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+        if(lists_[i].head != nullptr){
+            flush(i, lists_[i].length);
+        }
+    }
+    publishRequests();
+}
+
+void ThreadCache::publishRequests(){
+    for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+        publishRequests(i);
+    }
+}
+
+void ThreadCache::publishRequests(size_t index){
+#if ZP_ENABLE_STATS
+    FreeList& list = lists_[index];
+    if(list.requests != 0){
+        pool(index).CountRequested(list.requests, list.bytes_requested);
+        list.requests = 0;
+        list.bytes_requested = 0;
+    }
+#else
+    (void)index;
+#endif
+}
+
+void ThreadCache::refill(size_t index){
+    FreeList& list = lists_[index];
+    publishRequests(index);
+#if ZP_ENABLE_REMOTE_FREE
+    // 其他线程还回来的槽优先复用，不用访问共享内存池
+    if(heap_ != nullptr && drainRemote(index)){
+        return;
+    }
+#endif
+    // 线程可能已被调度到别的节点，每次 refill 重新确定节点
+    node_ = HashBucket::currentNumaNode();
+    const size_t want = list.length >= kTornDown ? 1 : batchSize(index);
+    size_t got = 0;
+    if constexpr (ZP_POOL_SHARDS > 1){
+        // 自己的分片要申请新 block 之前，先偷同一节点其他分片的空闲槽
+        got = pool(index).FetchChain(list.head, want, false);
+        for(int i = 1; got == 0 && i < ZP_POOL_SHARDS; i++){
+            got = poolAt(node_ * ZP_POOL_SHARDS + (shard_ + i) % ZP_POOL_SHARDS, static_cast<int>(index)).StealChain(list.head, want);
+        }
+    }
+    if(got == 0){
+        got = pool(index).FetchChain(list.head, want);
+    }
+    list.length += got;
+#if ZP_ENABLE_REMOTE_FREE
+    if(heap_ != nullptr){
+        claimBlocks(list.head);
+    }
+#endif
+}
+
+#if ZP_ENABLE_NUMA || ZP_ENABLE_REMOTE_FREE
+bool ThreadCache::deallocateRemote(void* ptr, size_t index){
+    BlockHeader* block = PageMap::get(ptr);
+#if ZP_ENABLE_NUMA
+    if(numa_ && nodeOf(block->owner) != node_){
+        // 其他节点的槽直接还给所属节点的内存池，不进入本线程缓存（deallocate() 已经检查过）
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        block->owner->ReleaseChain(slot, slot);
+        return true;
+    }
+#endif
+#if ZP_ENABLE_REMOTE_FREE
+    ThreadHeap* heap = block->heap.load(std::memory_order_acquire);
+    if(heap == nullptr || heap == heap_ || heap_ == nullptr || !heap->alive.load(std::memory_order_acquire)){
+        return false;
+    }
+    // 压入所属线程的队列；只有所属线程整条取走，push 不存在 ABA 问题。
+    // 所属线程可能在检查 alive 之后退出：队列已关闭时留在本线程缓存
+    Slot* slot = reinterpret_cast<Slot*>(ptr);
+    Slot* head = heap->remote[index].load(std::memory_order_relaxed);
+    do{
+        if(head == closedQueue()){
+            return false;
+        }
+        slot->setNext(head);
+    }while(!heap->remote[index].compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+    return true;
+#else
+    return false;
+#endif
+}
+#endif
+
+#if ZP_ENABLE_REMOTE_FREE
+bool ThreadCache::drainRemote(size_t index){
+    std::atomic<Slot*>& queue = heap_->remote[index];
+    if(queue.load(std::memory_order_relaxed) == nullptr){
+        return false;
+    }
+    return takeRemote(index, queue.exchange(nullptr, std::memory_order_acquire));
+}
+
+bool ThreadCache::takeRemote(size_t index, Slot* chain){
+    if(chain == nullptr){
+        return false;
+    }
+    FreeList& list = lists_[index];
+    Slot* tail = chain;
+    size_t n = 1;
+    while(tail->getNext() != nullptr){
+        tail = tail->getNext();
+        ++n;
+    }
+    tail->setNext(list.head);
+    list.head = chain;
+    list.length += n;
+    if(list.length > 2 * batchSize(index)){
+        // 一次还回来太多，超出的部分交给共享内存池
+        flush(index, list.length - batchSize(index));
+    }
+    return true;
+}
+
+void ThreadCache::claimBlocks(Slot* chain){
+    // 链上相邻的槽大多来自同一个 block，只在跨出当前 block 时才查 PageMap
+    BlockHeader* block = nullptr;
+    for(Slot* slot = chain; slot != nullptr; slot = slot->getNext()){
+        char* p = reinterpret_cast<char*>(slot);
+        if(block == nullptr || p < reinterpret_cast<char*>(block) || p >= reinterpret_cast<char*>(block) + block->size){
+            block = PageMap::get(slot);
+            // 只认领没有主人或主人已退出的 block：两个活着的线程从同一个 block 取槽时，
+            // 不能来回改写，否则一个线程自己的释放会被送进另一个线程（可能正在退出）的队列
+            ThreadHeap* owner = block->heap.load(std::memory_order_acquire);
+            if(owner != heap_ && (owner == nullptr || !owner->alive.load(std::memory_order_relaxed))){
+                block->heap.compare_exchange_strong(owner, heap_, std::memory_order_release, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+#endif
+
+void ThreadCache::allocateBatch(size_t index, void** out, size_t n, size_t requested){
+    FreeList& list = lists_[index];
+#if ZP_ENABLE_STATS
+    list.requests += n;
+    list.bytes_requested += n * (requested != 0 ? requested : SizeClass::size(index));
+#else
+    (void)requested;
+#endif
+    size_t i = 0;
+    for(; i < n && list.head != nullptr; ++i){
+        out[i] = list.head;
+        list.head = list.head->getNext();
+        --list.length;
+        Hardening::onAllocate(out[i], SizeClass::size(index));
+    }
+    if(i < n){
+        pool(index).AllocateBatch(out + i, n - i);
+    }
+}
+
+void ThreadCache::deallocateBatch(size_t index, void** ptrs, size_t n){
+#if ZP_ENABLE_NUMA
+    if(numa_){
+        // 批量里可能混有多个节点的槽，逐个按所属内存池归还
+        for(size_t i = 0; i < n; ++i){
+            if(ptrs[i] != nullptr){
+                deallocate(ptrs[i], index);
+            }
+        }
+        return;
+    }
+#endif
+    // 先串成一条链
+    Slot* head = nullptr;
+    Slot* tail = nullptr;
+    size_t count = 0;
+    for(size_t i = 0; i < n; ++i){
+        Slot* slot = reinterpret_cast<Slot*>(ptrs[i]);
+        if(slot == nullptr){
+            continue;
+        }
+        if constexpr (Hardening::kEnabled){
+            MemoryPool::CheckSlot(slot, nullptr, SizeClass::size(index));
+        }
+        Hardening::onFree(slot, SizeClass::size(index));
+        if(tail){
+            tail->setNext(slot);
+        }else{
+            head = slot;
+        }
+        tail = slot;
+        ++count;
+    }
+    if(head == nullptr){
+        return;
+    }
+    FreeList& list = lists_[index];
+    if(list.length + count > 2 * batchSize(index)){
+        // 本地放不下，整条链直接还给共享内存池，只加一次锁
+        release(head, tail, index);
+        return;
+    }
+    tail->setNext(list.head);
+    list.head = head;
+    list.length += count;
+}
+
+void ThreadCache::flush(size_t index, size_t count){
+    FreeList& list = lists_[index];
+    publishRequests(index);
+    if(count == 0 || list.head == nullptr){
+        return;
+    }
+    // 从链表头截取 count 个槽，批量还给共享内存池
+    Slot* head = list.head;
+    Slot* tail = head;
+    size_t n = 1;
+    while(n < count && tail->getNext() != nullptr){
+        tail = tail->getNext();
+        ++n;
+    }
+    list.head = tail->getNext();
+    list.length -= n;
+    release(head, tail, index);
+}
+
+void ThreadCache::release(Slot* head, Slot* tail, size_t index){
+#if ZP_ENABLE_NUMA
+    const bool mixed = numa_ || ZP_POOL_SHARDS > 1;
+#else
+    constexpr bool mixed = ZP_POOL_SHARDS > 1;
+#endif
+    if(mixed){
+        // 链上的槽可能来自不同节点（线程迁移过）或其他分片（偷来的）
+        MemoryPool::ReleaseToOwners(head, tail);
+        return;
+    }
+    pool(index).ReleaseChain(head, tail);
+}
+
+MemoryPool& ThreadCache::pool(size_t index) const{
+    // 热路径：node_ 和 shard_ 总在范围内，不走 getMemoryPool() 的检查
+    return poolAt(node_ * ZP_POOL_SHARDS + shard_, static_cast<int>(index));
+}
+
+#if ZP_PER_CPU_CACHE
+constinit CpuCache::Slab CpuCache::slabs_[CpuCache::kMaxCpus]{};
+
+void CpuCache::lock(Slab& slab){
+    while(slab.busy.exchange(true, std::memory_order_acquire)){
+        while(slab.busy.load(std::memory_order_relaxed)){
+            std::this_thread::yield();
+        }
+    }
+}
+
+MemoryPool& CpuCache::pool(const Slab& slab, int cpu, size_t index){
+    return poolAt(slab.node * ZP_POOL_SHARDS + cpu % ZP_POOL_SHARDS, static_cast<int>(index));
+}
+
+void CpuCache::refill(Slab& slab, int cpu, size_t index){
+    FreeList& list = slab.lists[index];
+    publishRequests(slab, cpu, index);
+    slab.node = HashBucket::currentNumaNode();
+    const size_t want = ThreadCache::batchSize(index);
+    size_t got = 0;
+    if constexpr (ZP_POOL_SHARDS > 1){
+        // 与 ThreadCache::refill() 相同：申请新 block 之前先偷同一节点其他分片的空闲槽
+        got = pool(slab, cpu, index).FetchChain(list.head, want, false);
+        for(int i = 1; got == 0 && i < ZP_POOL_SHARDS; i++){
+            got = poolAt(slab.node * ZP_POOL_SHARDS + (cpu + i) % ZP_POOL_SHARDS, static_cast<int>(index)).StealChain(list.head, want);
+        }
+    }
+    if(got == 0){
+        got = pool(slab, cpu, index).FetchChain(list.head, want);
+    }
+    list.length += got;
+}
+
+void CpuCache::flush(Slab& slab, size_t index, size_t count){
+    FreeList& list = slab.lists[index];
+    if(count == 0 || list.head == nullptr){
+        return;
+    }
+    Slot* head = list.head;
+    Slot* tail = head;
+    size_t n = 1;
+    while(n < count && tail->getNext() != nullptr){
+        tail = tail->getNext();
+        ++n;
+    }
+    list.head = tail->getNext();
+    list.length -= n;
+    if(poolSets() > 1){
+        // 任何线程都可能在这个 CPU 上释放，槽可能属于任一节点、任一分片
+        MemoryPool::ReleaseToOwners(head, tail);
+        return;
+    }
+    poolAt(0, static_cast<int>(index)).ReleaseChain(head, tail);
+}
+
+void CpuCache::publishRequests(Slab& slab, int cpu, size_t index){
+#if ZP_ENABLE_STATS
+    FreeList& list = slab.lists[index];
+    if(list.requests != 0){
+        pool(slab, cpu, index).CountRequested(list.requests, list.bytes_requested);
+        list.requests = 0;
+        list.bytes_requested = 0;
+    }
+#else
+    (void)slab;
+    (void)cpu;
+    (void)index;
+#endif
+}
+
+void* CpuCache::allocateUncached(size_t index, size_t requested){
+    // 另一个线程在这个 CPU 上被抢占时正持有缓存：不等待，直接从内存池取一个槽
+    MemoryPool& p = poolAt(HashBucket::currentNumaNode() * ZP_POOL_SHARDS + HashBucket::currentShard(), static_cast<int>(index));
+    Slot* slot = nullptr;
+    p.FetchChain(slot, 1);
+#if ZP_ENABLE_STATS
+    p.CountRequested(1, requested != 0 ? requested : SizeClass::size(index));
+#else
+    (void)requested;
+#endif
+    Hardening::onAllocate(slot, SizeClass::size(index));
+    return slot;
+}
+
+void CpuCache::allocateBatch(int cpu, size_t index, void** out, size_t n, size_t requested){
+    Slab& slab = slabs_[cpu % kMaxCpus];
+    lock(slab);
+    FreeList& list = slab.lists[index];
+#if ZP_ENABLE_STATS
+    list.requests += n;
+    list.bytes_requested += n * (requested != 0 ? requested : SizeClass::size(index));
+#else
+    (void)requested;
+#endif
+    size_t i = 0;
+    for(; i < n && list.head != nullptr; ++i){
+        out[i] = list.head;
+        list.head = list.head->getNext();
+        --list.length;
+        Hardening::onAllocate(out[i], SizeClass::size(index));
+    }
+    if(i < n){
+        pool(slab, cpu, index).AllocateBatch(out + i, n - i);
+    }
+    slab.busy.store(false, std::memory_order_release);
+}
+
+void CpuCache::deallocateBatch(int cpu, size_t index, void** ptrs, size_t n){
+    Slot* head = nullptr;
+    Slot* tail = nullptr;
+    size_t count = 0;
+    for(size_t i = 0; i < n; ++i){
+        Slot* slot = reinterpret_cast<Slot*>(ptrs[i]);
+        if(slot == nullptr){
+            continue;
+        }
+        if constexpr (Hardening::kEnabled){
+            MemoryPool::CheckSlot(slot, nullptr, SizeClass::size(index));
+        }
+        Hardening::onFree(slot, SizeClass::size(index));
+        if(tail){
+            tail->setNext(slot);
+        }else{
+            head = slot;
+        }
+        tail = slot;
+        ++count;
+    }
+    if(head == nullptr){
+        return;
+    }
+    Slab& slab = slabs_[cpu % kMaxCpus];
+    lock(slab);
+    FreeList& list = slab.lists[index];
+    if(list.length + count <= 2 * ThreadCache::batchSize(index)){
+        tail->setNext(list.head);
+        list.head = head;
+        list.length += count;
+        head = nullptr;
+    }
+    slab.busy.store(false, std::memory_order_release);
+    if(head != nullptr){
+        // 本 CPU 放不下，整条链直接还给所属内存池
+        MemoryPool::ReleaseToOwners(head, tail);
+    }
+}
+
+void CpuCache::flushAll(){
+    for(int cpu = 0; cpu < kMaxCpus; cpu++){
+        Slab& slab = slabs_[cpu];
+        lock(slab);
+        for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+            flush(slab, i, slab.lists[i].length);
+            publishRequests(slab, cpu, i);
+        }
+        slab.busy.store(false, std::memory_order_release);
+    }
+}
+
+void CpuCache::publishRequests(){
+    for(int cpu = 0; cpu < kMaxCpus; cpu++){
+        Slab& slab = slabs_[cpu];
+        lock(slab);
+        for(size_t i = 0; i < MEMORY_POOL_NUM; i++){
+            publishRequests(slab, cpu, i);
+        }
+        slab.busy.store(false, std::memory_order_release);
+    }
+}
+
+size_t CpuCache::cachedSlots(int cpu){
+    Slab& slab = slabs_[cpu % kMaxCpus];
+    lock(slab);
+    size_t n = 0;
+    for(const FreeList& list : slab.lists){
+        n += list.length;
+    }
+    slab.busy.store(false, std::memory_order_release);
+    return n;
 }
+#endif
 
 
 
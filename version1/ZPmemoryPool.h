@@ -9,22 +9,230 @@
 #ifndef ZP_MEMORY_POOL_H
 #define ZP_MEMORY_POOL_H
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <mutex>
+#include <chrono>
+#include <iosfwd>
+#include <new>
+#include <type_traits>
 #include <utility>
 
+#include "BlockProvider.h"
+#include "Hardening.h"
+#include "HeapProfiler.h"
+#include "PageMap.h"
+
+/// @brief 1 when the CPU number can be read from the glibc-registered rseq area (ZP_PER_CPU_CACHE)
+#if ZP_PER_CPU_CACHE && defined(__linux__) && __has_include(<sys/rseq.h>)
+#define ZP_HAVE_RSEQ 1
+#include <sys/rseq.h>
+#else
+#define ZP_HAVE_RSEQ 0
+#endif
+
 /**
  * @namespace ZPmemoryPool
  * @brief  Memory Pool namespace containing all memory pool related classes and functions
  */
 namespace ZPmemoryPool {
 
-/// @brief Number of memory pools
-#define MEMORY_POOL_NUM 64
-/// @brief Base size for memory slots (in bytes)
-#define SLOT_BASE_SIZE 8
-/// @brief Maximum size for memory slots (in bytes)
-#define MAX_SLOT_SIZE 512
+/// @brief Number of HashBucket pools, SizeClass::kNumClasses (per-family: BasicSizeClass<Config>::kNumClasses)
+#define MEMORY_POOL_NUM (static_cast<int>(::ZPmemoryPool::SizeClass::kNumClasses))
+/// @brief Spacing of HashBucket's smallest classes, DefaultSizeClasses::kSpacing (in bytes)
+#define SLOT_BASE_SIZE (::ZPmemoryPool::DefaultSizeClasses::kSpacing)
+/// @brief Largest HashBucket slot, DefaultSizeClasses::kMaxSize (in bytes)
+#define MAX_SLOT_SIZE (::ZPmemoryPool::DefaultSizeClasses::kMaxSize)
+/// @brief Cache line size used to keep independently written fields apart (in bytes)
+#define CACHE_LINE_SIZE 64
+
+/// @brief Compile the per-pool statistics counters (0 removes them entirely)
+#ifndef ZP_ENABLE_STATS
+#define ZP_ENABLE_STATS 1
+#endif
+
+/// @brief Keep one set of pools per NUMA node (needs libnuma)
+#ifndef ZP_ENABLE_NUMA
+#define ZP_ENABLE_NUMA 0
+#endif
+
+/// @brief Route cross-thread frees back to the allocating thread through lock-free queues
+#ifndef ZP_ENABLE_REMOTE_FREE
+#define ZP_ENABLE_REMOTE_FREE 1
+#endif
+
+/// @brief Serve HashBucket from per-CPU caches instead of per-thread caches where rseq is available
+#ifndef ZP_PER_CPU_CACHE
+#define ZP_PER_CPU_CACHE 0
+#endif
+
+/// @brief Pools per size class on each NUMA node; threads are spread over them round-robin
+#ifndef ZP_POOL_SHARDS
+#define ZP_POOL_SHARDS 1
+#endif
+
+/// @brief Default of HashBucket::setReleaseAtExit(): 0 skips all work at process exit
+#ifndef ZP_RELEASE_AT_EXIT
+#define ZP_RELEASE_AT_EXIT 1
+#endif
+
+/// @brief Number of NUMA nodes with their own pools; further nodes share them modulo this
+#if ZP_ENABLE_NUMA
+#define MAX_NUMA_NODES 8
+#else
+#define MAX_NUMA_NODES 1
+#endif
+
+/**
+ * @struct DefaultSizeClasses
+ * @brief Size-class parameters of HashBucket, and the base of custom configurations
+ *
+ * A configuration for BasicSizeClass/BasicHashBucket is any type with these
+ * static constexpr members; deriving from DefaultPoolConfig and redefining
+ * some of them is the simplest way to write one.
+ */
+struct DefaultSizeClasses{
+    /// @brief Spacing of the linear classes, and the smallest slot (a power of two, >= 8)
+    static constexpr size_t kSpacing = 8;
+    /// @brief Largest size served with linear spacing (a power of two multiple of kSpacing)
+    static constexpr size_t kLinearMax = 64;
+    /// @brief Classes per power of two above kLinearMax (a power of two, <= kLinearMax)
+    static constexpr size_t kClassesPerDoubling = 4;
+    /// @brief Largest slot, the last class (a power of two, >= kLinearMax)
+    static constexpr size_t kMaxSize = 32768;
+};
+
+/**
+ * @class BasicSizeClass
+ * @brief Compile-time size-class table
+ * @tparam Config Size-class parameters, see DefaultSizeClasses
+ *
+ * Sizes up to kLinearMax use kSpacing spacing (8, 16, ..., 64 by default).
+ * Above that every power-of-two range (2^k, 2^(k+1)] is split into
+ * kClassesPerDoubling classes of equal width, e.g. 80, 96, 112, 128, 160,
+ * ..., 28672, 32768. The worst-case rounding waste is therefore 25% instead
+ * of growing with the size, and the default table reaches 32 KiB with only
+ * 44 pools. All members are constexpr, so with a constant size the class
+ * index folds to a constant.
+ */
+template<typename Config>
+class BasicSizeClass{
+public:
+    /// @brief Spacing of the linear classes
+    static constexpr size_t kSpacing = Config::kSpacing;
+    /// @brief Largest size served with linear spacing
+    static constexpr size_t kLinearMax = Config::kLinearMax;
+    /// @brief Number of linearly spaced classes
+    static constexpr size_t kLinearClasses = kLinearMax / kSpacing;
+    /// @brief Classes per power of two above kLinearMax
+    static constexpr size_t kClassesPerDoubling = Config::kClassesPerDoubling;
+    /// @brief Largest slot size
+    static constexpr size_t kMaxSize = Config::kMaxSize;
+    /// @brief Total number of size classes
+    static constexpr size_t kNumClasses = kLinearClasses
+        + (std::bit_width(kMaxSize) - std::bit_width(kLinearMax)) * kClassesPerDoubling;
+
+    static_assert(std::has_single_bit(kSpacing) && kSpacing >= sizeof(void*), "kSpacing must be a power of two holding a pointer");
+    static_assert(std::has_single_bit(kLinearMax) && kLinearMax >= kSpacing, "kLinearMax must be a power of two of at least kSpacing");
+    static_assert(std::has_single_bit(kClassesPerDoubling) && kClassesPerDoubling <= kLinearMax,
+                  "kClassesPerDoubling must be a power of two of at most kLinearMax");
+    static_assert(std::has_single_bit(kMaxSize) && kMaxSize >= kLinearMax, "kMaxSize must be a power of two of at least kLinearMax");
+
+    /**
+     * @brief Slot size of a class
+     * @param index Class index in [0, kNumClasses)
+     * @return Slot size in bytes
+     */
+    static constexpr size_t size(size_t index){ return kSizes[index]; }
+
+    /**
+     * @brief Alignment every slot of a class is guaranteed to have
+     * @param index Class index in [0, kNumClasses)
+     * @return Largest power of two dividing size(index), capped at 4096
+     *
+     * Matches MemoryPool's slot placement. Because any object fitting the
+     * class has a size whose alignment is at most this, slots are always
+     * naturally aligned.
+     */
+    static constexpr size_t alignment(size_t index){
+        const size_t align = kSizes[index] & (~kSizes[index] + 1);
+        return align > kMaxAlignment ? kMaxAlignment : align;
+    }
+
+    /// @brief Cap of alignment(), equal to the page size
+    static constexpr size_t kMaxAlignment = 4096;
+
+    /**
+     * @brief Smallest class whose slots hold size bytes
+     * @param size Requested size in [1, kMaxSize]
+     * @return Class index
+     *
+     * One branch for the linear range, otherwise a bit_width (lzcnt) and a
+     * shift; no table lookup or loop.
+     */
+    static constexpr size_t index(size_t size){
+        if(size <= kLinearMax){
+            // equal size/kSpacing 向上去整（因为分配内存只能大不能小）
+            return (size + kSpacing - 1) / kSpacing - 1;
+        }
+        // size 落在 (2^k, 2^(k+1)] 区间，区间内等分为 kClassesPerDoubling 档
+        const size_t k = std::bit_width(size - 1) - 1;
+        return kLinearClasses + (k - kLinearShift) * kClassesPerDoubling
+             + ((size - 1 - (size_t(1) << k)) >> (k - kGroupShift));
+    }
+
+    /**
+     * @brief Smallest class whose slots hold size bytes at the given alignment
+     * @param size Requested size in [1, kMaxSize]
+     * @param align Required alignment, a power of two
+     * @return Class index, or kNumClasses if no class is aligned enough
+     *
+     * Starts from index(max(size, align)) and walks up at most a few classes:
+     * the last class of every power-of-two range is that power of two.
+     */
+    static constexpr size_t index(size_t size, size_t align){
+        if(align > kMaxAlignment || (size < align ? align : size) > kSizes[kNumClasses - 1]){
+            return kNumClasses;
+        }
+        size_t i = index(size < align ? align : size);
+        while(alignment(i) < align){
+            ++i;
+        }
+        return i;
+    }
+
+private:
+    static constexpr size_t kLinearShift = std::bit_width(kLinearMax) - 1;
+    static constexpr size_t kGroupShift = std::bit_width(kClassesPerDoubling) - 1;
+
+    static constexpr std::array<size_t, kNumClasses> makeSizes(){
+        std::array<size_t, kNumClasses> sizes{};
+        size_t i = 0;
+        for(; i < kLinearClasses; ++i){
+            sizes[i] = (i + 1) * kSpacing;
+        }
+        for(size_t base = kLinearMax; i < kNumClasses; base *= 2){
+            for(size_t j = 1; j <= kClassesPerDoubling; ++j){
+                sizes[i++] = base + j * (base / kClassesPerDoubling);
+            }
+        }
+        return sizes;
+    }
+
+    static const std::array<size_t, kNumClasses> kSizes;
+};
+
+template<typename Config>
+inline constexpr std::array<size_t, BasicSizeClass<Config>::kNumClasses> BasicSizeClass<Config>::kSizes =
+    BasicSizeClass<Config>::makeSizes();
+
+/// @brief Size-class table of HashBucket
+using SizeClass = BasicSizeClass<DefaultSizeClasses>;
+
+static_assert(SizeClass::size(SizeClass::kNumClasses - 1) == SizeClass::kMaxSize, "last size class must be kMaxSize");
 
 /**
  * @struct Slot
@@ -35,7 +243,147 @@ namespace ZPmemoryPool {
  * to the next available slot.
  */
 struct Slot{
-    Slot* next; ///< Pointer to the next free slot
+    Slot* next; ///< Pointer to the next free slot, XOR-encoded with ZP_HARDENED: use getNext()/setNext()
+
+    /// @brief Next free slot (aborts on a corrupted link with ZP_HARDENED)
+    Slot* getNext() const{
+        return static_cast<Slot*>(Hardening::decode(this, reinterpret_cast<std::uintptr_t>(next)));
+    }
+    /// @brief Next free slot without the integrity check, for racy reads that are validated later
+    Slot* peekNext() const{
+        return reinterpret_cast<Slot*>(reinterpret_cast<std::uintptr_t>(next) ^ Hardening::encode(this, nullptr));
+    }
+    /// @brief Link this slot to another one
+    void setNext(Slot* slot){
+        next = reinterpret_cast<Slot*>(Hardening::encode(this, slot));
+    }
+};
+
+class MemoryPool;
+
+struct ThreadHeap;
+
+/**
+ * @struct BlockHeader
+ * @brief Bookkeeping stored at the start of every pool block
+ *
+ * Blocks are page aligned and registered in the PageMap, so the header of
+ * the block holding any slot can be found in O(1).
+ */
+struct BlockHeader{
+    /// @brief Value of bin while the block is in no fullness bin
+    static constexpr int kNoBin = -1;
+
+    BlockHeader(BlockHeader* next_block, MemoryPool* pool, BlockProvider* source, size_t bytes)
+    : next(next_block), owner(pool), provider(source), size(bytes), live(0), heap(nullptr),
+      free(nullptr), bin_prev(nullptr), bin_next(nullptr), bin(kNoBin), reclaim(false) {}
+
+    BlockHeader*        next;       ///< Next block of the same pool
+    MemoryPool*         owner;      ///< Pool that carved this block
+    BlockProvider*      provider;   ///< Provider the block is returned to
+    size_t              size;       ///< Block size in bytes, a multiple of PageMap::kPageSize
+    std::atomic<size_t> live;       ///< Slots of this block currently handed out
+    std::atomic<ThreadHeap*> heap;  ///< Thread heap that last refilled from this block (ZP_ENABLE_REMOTE_FREE)
+    Slot*               free;       ///< Free slots of this block (FreeListPolicy::PerBlock)
+    BlockHeader*        bin_prev;   ///< Neighbours in the owner's fullness bin (FreeListPolicy::PerBlock)
+    BlockHeader*        bin_next;
+    int                 bin;        ///< Fullness bin the block is linked into, kNoBin if none
+    bool                reclaim;    ///< Scratch flag used by MemoryPool::Trim()
+};
+
+/**
+ * @struct PoolStats
+ * @brief Point-in-time statistics of one MemoryPool
+ *
+ * Counters are gathered with relaxed atomics and are only populated when
+ * the library is built with ZP_ENABLE_STATS; otherwise everything except
+ * slot_size and bytes_reserved reads zero. Allocations and frees count
+ * slots crossing the pool boundary, so with a ThreadCache in front they
+ * move in batches.
+ */
+struct PoolStats{
+    size_t          slot_size = 0;              ///< Slot size of the pool in bytes
+    std::uint64_t   allocations = 0;            ///< Slots handed out
+    std::uint64_t   frees = 0;                  ///< Slots returned
+    std::uint64_t   blocks_allocated = 0;       ///< Blocks obtained from the system so far
+    size_t          bytes_reserved = 0;         ///< Bytes of blocks currently held
+    size_t          bytes_live = 0;             ///< Bytes of slots currently handed out
+    size_t          free_list_length = 0;       ///< Slots currently on the free list
+    size_t          free_list_high_water = 0;   ///< Largest free list length seen
+    std::uint64_t   lock_contention = 0;        ///< Lock acquisitions whose try_lock() failed
+};
+
+/**
+ * @struct FragmentationStats
+ * @brief Where the memory of one MemoryPool goes, from a walk of its blocks
+ *
+ * Every byte of bytes_reserved is either block overhead, tail waste or
+ * part of a slot, and every slot is live, free or not carved yet:
+ *
+ *     bytes_reserved = block_overhead + tail_waste + slots_total * slot_size
+ *     slots_total    = slots_live + slots_free + slots_uncarved
+ *
+ * The request counters measure rounding to the slot size. They need
+ * ZP_ENABLE_STATS, only count allocations made through HashBucket (and
+ * PoolAllocator), and threads hand them to the pools in batches, on cache
+ * refills and flushes; HashBucket::fragmentationReport() includes the
+ * calling thread's own counts.
+ */
+struct FragmentationStats{
+    size_t          slot_size = 0;          ///< Slot size of the pool in bytes
+    size_t          blocks = 0;             ///< Blocks currently held
+    size_t          bytes_reserved = 0;     ///< Bytes of those blocks
+    size_t          block_overhead = 0;     ///< Block headers and alignment padding before the first slot
+    size_t          tail_waste = 0;         ///< Bytes after the last whole slot of each block
+    size_t          slots_total = 0;        ///< Slots the blocks hold
+    size_t          slots_live = 0;         ///< Slots handed out, including those cached by threads
+    size_t          slots_free = 0;         ///< Slots on the free list
+    size_t          slots_uncarved = 0;     ///< Slots of the current block not carved yet
+    std::uint64_t   requests = 0;           ///< Allocations counted so far (ZP_ENABLE_STATS)
+    std::uint64_t   bytes_requested = 0;    ///< Bytes asked for by those allocations
+    std::uint64_t   bytes_handed_out = 0;   ///< requests * slot_size
+
+    /// @brief Bytes lost to rounding requests up to the slot size
+    std::uint64_t internalWaste() const{ return bytes_handed_out - bytes_requested; }
+
+    /// @brief Add the counts of another pool (slot_size is kept)
+    FragmentationStats& operator+=(const FragmentationStats& other){
+        blocks += other.blocks;
+        bytes_reserved += other.bytes_reserved;
+        block_overhead += other.block_overhead;
+        tail_waste += other.tail_waste;
+        slots_total += other.slots_total;
+        slots_live += other.slots_live;
+        slots_free += other.slots_free;
+        slots_uncarved += other.slots_uncarved;
+        requests += other.requests;
+        bytes_requested += other.bytes_requested;
+        bytes_handed_out += other.bytes_handed_out;
+        return *this;
+    }
+};
+
+/**
+ * @enum FreeListPolicy
+ * @brief How a MemoryPool synchronizes access to its free list
+ */
+enum class FreeListPolicy{
+    Locked,     ///< free list guarded by mutex_for_free_list_ (default)
+    LockFree,   ///< Treiber stack on a generation-tagged head pointer
+    PerBlock    ///< one free list per block, guarded by mutex_for_free_list_; slots come from the fullest block
+};
+
+/**
+ * @struct BlockSizePolicy
+ * @brief Geometric growth policy for the blocks of a MemoryPool
+ *
+ * The first block has initial_size bytes; each following block doubles the
+ * previous one until max_size is reached. Setting both to the same value
+ * gives fixed-size blocks.
+ */
+struct BlockSizePolicy{
+    size_t initial_size = 4096;     ///< Size of the first block in bytes
+    size_t max_size = 64 * 1024;    ///< Upper bound for block growth in bytes
 };
 
 /**
@@ -48,9 +396,12 @@ struct Slot{
  * 
  * Features:
  * - Thread-safe operations using mutexes
+ * - Optional lock-free free list (see FreeListPolicy)
  * - Efficient memory reuse through free list management
  * - Automatic block allocation when needed
- * - Configurable block and slot sizes
+ * - Configurable block and slot sizes, with geometric block growth
+ * - Free-list and bump state on separate cache lines (no false sharing
+ *   between the two paths, nor between neighbouring pools in an array)
  * 
  * @note This implementation is designed for scenarios where frequent
  *       allocations and deallocations of same-sized objects occur.
@@ -59,13 +410,35 @@ class MemoryPool{
 public:
     /**
      * @brief Constructor that initializes the memory pool
-     * @param block_size_ The size of each memory block in bytes (default: 4096)
+     * @param block_size_ The size of the first memory block in bytes (default: 4096)
+     * @param max_block_size Cap for block growth in bytes (default: 0, fixed-size blocks)
      * 
      * Creates a new memory pool with the specified block size.
      * The block size determines how much memory is allocated at once
-     * when the pool needs to expand.
+     * when the pool needs to expand. With max_block_size larger than
+     * block_size_ every new block doubles the previous one up to the cap.
+     */
+    MemoryPool(size_t block_size_ = 4096, size_t max_block_size = 0);
+
+    /**
+     * @brief Constructor for a pool that is ready to use without init()
+     * @param slot_size The size of each slot in bytes
+     * @param block_policy Block growth policy
+     * @param policy Synchronization used for the free list (default: Locked)
+     * @param provider Source of the blocks (default: nullptr, BlockProvider::defaultProvider())
+     *
+     * The constructor is constexpr, so static pools built with it are
+     * constant-initialized: no start-up code runs and they can be used
+     * before dynamic initialization of other objects has happened.
      */
-    MemoryPool(size_t block_size_ = 4096);
+    constexpr MemoryPool(size_t slot_size, const BlockSizePolicy& block_policy,
+                         FreeListPolicy policy = FreeListPolicy::Locked,
+                         BlockProvider* provider = nullptr)
+    : block_size_(block_policy.initial_size), initial_block_size_(block_policy.initial_size),
+      max_block_size_(block_policy.max_size < block_policy.initial_size ? block_policy.initial_size : block_policy.max_size),
+      slot_size_(slot_size), policy_(policy), provider_(provider), free_list_(nullptr),
+      tagged_free_list_(0), bins_{}, current_slot_(nullptr), last_slot_(nullptr), first_block_(nullptr)
+    {}
     
     /**
      * @brief Destructor that cleans up all allocated memory
@@ -78,11 +451,56 @@ public:
     /**
      * @brief Initialize the memory pool with a specific slot size
      * @param slot_size The size of each slot in bytes
+     * @param policy Synchronization used for the free list (default: Locked)
      * 
-     * This method must be called before using Allocate() or Deallocate().
+     * This method must be called before using Allocate() or Deallocate()
+     * unless the pool was constructed with a slot size.
      * It sets up the internal structure based on the desired slot size.
+     *
+     * Calling init() on a pool that already owns blocks keeps them: the
+     * slot size must stay the same and only the free list policy is
+     * switched (the free slots are moved over, so the pool has to be
+     * quiescent while this happens).
+     */
+    void init(size_t slot_size, FreeListPolicy policy = FreeListPolicy::Locked);
+
+    /**
+     * @brief Get the synchronization policy selected in init()
+     * @return The free list policy of this pool
+     */
+    FreeListPolicy policy() const { return policy_; }
+
+    /**
+     * @brief Change the block growth policy
+     * @param policy Initial and maximum block size
+     *
+     * Takes effect for the next block; init() restarts growth from
+     * policy.initial_size. A max_size below initial_size is raised to it.
+     */
+    void setBlockSizePolicy(const BlockSizePolicy& policy);
+
+    /**
+     * @brief Size of the block the pool will allocate next
+     * @return Block size in bytes
+     */
+    size_t nextBlockSize() const { return block_size_; }
+
+    /**
+     * @brief Change where new blocks come from
+     * @param provider Upstream provider, or nullptr for BlockProvider::defaultProvider()
+     *
+     * Takes effect for the next block. Blocks the pool already holds keep
+     * going back to the provider that supplied them.
+     */
+    void setBlockProvider(BlockProvider* provider);
+
+    /**
+     * @brief Provider used for the next block
+     * @return The provider set with setBlockProvider(), or the default one
      */
-    void init(size_t slot_size);
+    BlockProvider& blockProvider() const {
+        return provider_ != nullptr ? *provider_ : BlockProvider::defaultProvider();
+    }
 
     /**
      * @brief Allocate a memory slot from the pool
@@ -102,7 +520,137 @@ public:
      * @param ptr 
      */
     void Deallocate(void* ptr);
+
+    /**
+     * @brief Allocate n slots with a single pass over the pool
+     * @param out Array that receives n slot pointers
+     * @param n Number of slots to allocate
+     *
+     * Equivalent to n calls of Allocate(), but the free list and the
+     * current block are each locked at most once.
+     *
+     * @note This method is thread-safe
+     */
+    void AllocateBatch(void** out, size_t n);
+
+    /**
+     * @brief Return n slots to the pool at once
+     * @param ptrs Array of slots previously obtained from this pool
+     * @param n Number of entries in ptrs (nullptr entries are skipped)
+     *
+     * The slots are linked into one chain outside the lock and spliced
+     * into the free list with a single lock round-trip.
+     *
+     * @note This method is thread-safe
+     */
+    void DeallocateBatch(void** ptrs, size_t n);
+
+    /**
+     * @brief Give blocks without live slots back to the system
+     * @return Number of bytes released
+     *
+     * Every block whose live-slot count is zero has its slots unlinked from
+     * the free list and is handed back to its BlockProvider. Slots held in
+     * thread caches count as live.
+     *
+     * With FreeListPolicy::PerBlock the free slots of a block are already
+     * on its own list, so the free list is not walked at all.
+     *
+     * @note Pools using FreeListPolicy::LockFree never release blocks (a
+     *       concurrent pop may still read a slot's next pointer), so Trim()
+     *       returns 0 for them.
+     */
+    size_t Trim();
+
+    /**
+     * @brief Grow the pool to hold at least n_slots slots and prefault them
+     * @param n_slots Wanted capacity in slots (handed out, free and not yet carved)
+     * @return Number of slots added
+     *
+     * Allocates as many blocks as needed and touches every page of the
+     * memory not handed out yet (BlockProvider::prefault()), so the first
+     * allocations after a warm-up neither call AllocateNewBlock() nor take
+     * page faults. If the current block is replaced, its uncarved rest goes
+     * to the free list first, so no memory is skipped.
+     *
+     * @note This method is thread-safe. init() must have been called.
+     */
+    size_t Reserve(size_t n_slots);
+
+    /**
+     * @brief Snapshot the statistics of this pool
+     * @return Current counters (see PoolStats)
+     *
+     * @note This method is thread-safe; the fields are read independently
+     *       and may be slightly inconsistent with each other under load.
+     */
+    PoolStats stats() const;
+
+    /**
+     * @brief Walk the blocks of this pool and account for every byte
+     * @return Block, slot and request breakdown (see FragmentationStats)
+     *
+     * @note This method is thread-safe. It holds the block lock for one pass
+     *       over the block list; live counts may move under load.
+     */
+    FragmentationStats fragmentation();
 private:
+    friend class ThreadCache;
+    friend class CpuCache;
+
+    /**
+     * @brief Take up to n slots from the pool as one null-terminated chain
+     * @param head Receives the first slot of the chain
+     * @param n Number of slots wanted
+     * @param grow Allocate new blocks when the current one runs out (default: true)
+     * @return Number of slots linked into the chain (n when grow is true)
+     *
+     * Drains the free list first under a single lock, then carves whatever
+     * is still missing from the current block under the block lock.
+     */
+    size_t FetchChain(Slot*& head, size_t n, bool grow = true);
+
+    /**
+     * @brief Take up to n slots from the free list only, without ever waiting
+     * @param head Receives the first slot of the chain (nullptr if none)
+     * @param n Number of slots wanted
+     * @return Number of slots linked into the chain
+     *
+     * Used by a thread whose own shard ran dry to take free slots of a
+     * sibling shard before growing its own; gives up if the free-list lock
+     * is held.
+     */
+    size_t StealChain(Slot*& head, size_t n);
+
+    /**
+     * @brief Unlink up to n slots from the head of the free list
+     * @param head Receives the first slot
+     * @param tail Receives the last slot
+     * @param n Number of slots wanted
+     * @param wait Block on a held free-list lock (false: give up immediately)
+     * @return Number of slots taken, with their live counts already adjusted
+     */
+    size_t TakeFree(Slot*& head, Slot*& tail, size_t n, bool wait);
+
+    /**
+     * @brief Give a chain whose slots may belong to different pools back to their owners
+     * @param head First slot of the chain
+     * @param tail Last slot of the chain
+     *
+     * Each run of consecutive slots with the same owner costs one
+     * ReleaseChain(), so Trim() finds every slot on its own pool's free list.
+     */
+    static void ReleaseToOwners(Slot* head, Slot* tail);
+
+    /**
+     * @brief Give a pre-linked chain of slots back to the free list
+     * @param head First slot of the chain
+     * @param tail Last slot of the chain
+     *
+     * The whole chain is spliced in front of free_list_ under one lock.
+     */
+    void ReleaseChain(Slot* head, Slot* tail);
+
     /**
      * @brief Allocate a new memory block when the current block is exhausted
      * 
@@ -114,6 +662,109 @@ private:
      */
     void AllocateNewBlock();
     
+    /**
+     * @brief Adjust the live-slot counts of the blocks holding a chain
+     * @param head First slot of the chain
+     * @param tail Last slot of the chain (inclusive)
+     * @param allocated true when the slots leave the pool, false when they return
+     * @return Number of slots in the chain
+     */
+    static size_t AdjustLive(Slot* head, Slot* tail, bool allocated);
+
+    /**
+     * @class CountedLock
+     * @brief lock_guard that records a failed try_lock() as contention
+     */
+    class CountedLock{
+    public:
+        CountedLock(std::mutex& mutex, MemoryPool& pool) : mutex_(mutex){
+#if ZP_ENABLE_STATS
+            if(mutex_.try_lock()){
+                return;
+            }
+            pool.stats_.lock_contention.fetch_add(1, std::memory_order_relaxed);
+#else
+            (void)pool;
+#endif
+            mutex_.lock();
+        }
+        ~CountedLock(){ mutex_.unlock(); }
+        CountedLock(const CountedLock&) = delete;
+        CountedLock& operator=(const CountedLock&) = delete;
+    private:
+        std::mutex& mutex_;
+    };
+
+    /**
+     * @name Statistics hooks
+     * Compiled to nothing when ZP_ENABLE_STATS is 0.
+     * @{
+     */
+    /// @brief n slots left the pool, reused of them came from the free list
+    void CountAllocated(size_t n, size_t reused){
+#if ZP_ENABLE_STATS
+        stats_.allocations.fetch_add(n, std::memory_order_relaxed);
+        stats_.free_slots.fetch_sub(reused, std::memory_order_relaxed);
+#else
+        (void)n; (void)reused;
+#endif
+    }
+    /// @brief n slots were pushed onto the free list
+    void CountFreed(size_t n){
+#if ZP_ENABLE_STATS
+        stats_.frees.fetch_add(n, std::memory_order_relaxed);
+#endif
+        CountCarved(n);
+    }
+    /// @brief Threads made n allocations of this class asking for bytes in total
+    void CountRequested(std::uint64_t n, std::uint64_t bytes){
+#if ZP_ENABLE_STATS
+        stats_.requests.fetch_add(n, std::memory_order_relaxed);
+        stats_.bytes_requested.fetch_add(bytes, std::memory_order_relaxed);
+#else
+        (void)n; (void)bytes;
+#endif
+    }
+    /// @brief n slots appeared on the free list (returned or carved by Reserve())
+    void CountCarved(size_t n){
+#if ZP_ENABLE_STATS
+        size_t length = stats_.free_slots.fetch_add(n, std::memory_order_relaxed) + n;
+        size_t high = stats_.free_slots_high_water.load(std::memory_order_relaxed);
+        while(length > high && !stats_.free_slots_high_water.compare_exchange_weak(high, length, std::memory_order_relaxed)){
+        }
+#else
+        (void)n;
+#endif
+    }
+    /** @} */
+
+    /**
+     * @brief Unregister a block from the PageMap and free it
+     * @param block Block unlinked from first_block_
+     */
+    static void ReleaseBlock(BlockHeader* block);
+
+    /**
+     * @brief Number of slots a block of this pool holds
+     * @param block Block of this pool
+     */
+    size_t SlotsInBlock(BlockHeader* block);
+
+    /**
+     * @brief Abort unless ptr is the start of a slot of a pool block (ZP_HARDENED)
+     * @param ptr Pointer being freed
+     * @param pool Pool the slot must belong to, or nullptr to accept any pool
+     * @param slot_size Slot size the owning pool must have
+     */
+    static void CheckSlot(const void* ptr, const MemoryPool* pool, size_t slot_size);
+
+    /**
+     * @brief Push the not yet carved slots of the current block onto the free list
+     *
+     * @note Must be called with mutex_for_block_ held
+     */
+    void CarveRemainder();
+
     /**
      * @brief Calculate the padding needed for pointer alignment
      * @param p Pointer to be aligned
@@ -126,78 +777,1278 @@ private:
      */
     size_t PadPointer(char* p, size_t align);
 
+    /**
+     * @brief Alignment of the first slot in a block
+     * @param slot_size Slot size in bytes
+     * @return Largest power of two dividing slot_size, capped at kMaxSlotAlignment
+     *
+     * Because every slot is a multiple of this value away from the first
+     * one, all slots of the block share the same alignment.
+     */
+    static size_t SlotAlignment(size_t slot_size);
+
+    /// @brief Upper bound for SlotAlignment() so large classes don't waste a slot on padding
+    static constexpr size_t kMaxSlotAlignment = SizeClass::kMaxAlignment;
+
+    /**
+     * @name FreeListPolicy::PerBlock helpers
+     * Every block keeps its own free list. Blocks with free slots are linked
+     * into one of kFullnessBins bins by the share of their slots handed out,
+     * and slots are always taken from the fullest non-empty bin: long churn
+     * then refills nearly full blocks instead of spreading allocations over
+     * all of them, and blocks that drain completely stay untouched until
+     * Trim() releases them. All of it is guarded by mutex_for_free_list_.
+     * @{
+     */
+    static constexpr int kFullnessBins = 8;
+
+    /// @brief Take up to n slots, fullest block first, adjusting live counts
+    size_t PopPerBlock(Slot*& head, Slot*& tail, size_t n);
+    /// @brief Put a chain on the lists of the blocks its slots belong to (live counts already adjusted)
+    void PushPerBlock(Slot* head, Slot* tail);
+    /// @brief Unlink every block list into one null-terminated chain
+    Slot* DrainPerBlock();
+    /// @brief Move a block to the bin matching its fullness, or out of the bins if it has no free slot
+    void Rebin(BlockHeader* block);
+    /// @brief Remove a block from its bin
+    void UnlinkBin(BlockHeader* block);
+    /** @} */
+
+    /**
+     * @brief Pop one slot from the lock-free free list
+     * @return The popped slot, or nullptr if the list is empty
+     */
+    Slot* PopLockFree();
+
+    /**
+     * @brief Push a pre-linked chain onto the lock-free free list
+     * @param head First slot of the chain
+     * @param tail Last slot of the chain
+     */
+    void PushLockFree(Slot* head, Slot* tail);
+
+    /**
+     * @name Tagged pointer helpers
+     * The lock-free head packs a 48-bit slot address with a 16-bit
+     * generation counter in the upper bits. Every successful update bumps
+     * the generation, which defeats ABA without a double-width CAS.
+     * @{
+     */
+    static constexpr int           kTagShift = 48;
+    static constexpr std::uint64_t kPointerMask = (std::uint64_t(1) << kTagShift) - 1;
+
+    static Slot* TaggedSlot(std::uint64_t tagged){
+        return reinterpret_cast<Slot*>(static_cast<std::uintptr_t>(tagged & kPointerMask));
+    }
+    static std::uint64_t MakeTagged(Slot* slot, std::uint64_t previous){
+        return (((previous >> kTagShift) + 1) << kTagShift)
+             | (static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(slot)) & kPointerMask);
+    }
+    /** @} */
+
 private:
-    size_t          block_size_;            // 内存块大小
+    // 字段按写入方分组，每组独占 cache line：释放路径只写空闲链表组，
+    // 切分新槽只写 bump 组，互不失效；整个对象也按 cache line 对齐，
+    // 静态数组中相邻的内存池同样不会共享 cache line。
+
+    // 配置，初始化后基本只读
+    size_t          block_size_;            // 下一个内存块大小
+    size_t          initial_block_size_;    // 首个内存块大小
+    size_t          max_block_size_;        // 内存块增长上限
     size_t          slot_size_;             // 槽大小
-    Slot*           first_block_;            // 指向内存池管理的首个实际内存块
+    FreeListPolicy  policy_;                // 空闲链表的同步方式
+    BlockProvider*  provider_;              // 新 block 的来源，nullptr 表示默认的 operator new
+    std::atomic<size_t> bytes_reserved_{0}; // 当前持有的 block 总字节数（只在申请/归还 block 时写）
+
+    // 空闲链表状态
+    alignas(CACHE_LINE_SIZE)
+    std::atomic<Slot*> free_list_;          // 指向空闲的槽（被使用后又被释放的slot），Locked 模式使用
+    std::atomic<std::uint64_t> tagged_free_list_; // LockFree 模式下带版本号的空闲链表头
+    std::mutex      mutex_for_free_list_;   // 保证free_list_ 在多线程中的原子性
+    BlockHeader*    bins_[kFullnessBins];   // PerBlock 模式下按占用率分组、还有空闲槽的 block，bins_[7] 最满
+
+    // bump 状态：当前 block 中尚未切分的区间
+    alignas(CACHE_LINE_SIZE)
     Slot*           current_slot_;          // 指向当前未被使用的slot
-    Slot*           free_list_;             // 指向空闲的槽（被使用后又被释放的slot）
     Slot*           last_slot_;             // 作为当前内存块中最后能够存放元素的位置表示（超过该位置需要申请新的block）
-    std::mutex      mutex_for_free_list_;   // 保证free_list_ 在多线程中的原子性
+    BlockHeader*    first_block_;           // 指向内存池管理的首个实际内存块（也是当前正在切分的 block）
     std::mutex      mutex_for_block_;       // 保证多线程情况下避免不必要的重复开辟内存导致的浪费行为
 
+#if ZP_ENABLE_STATS
+    struct Counters{
+        std::atomic<std::uint64_t>  allocations{0};
+        std::atomic<std::uint64_t>  frees{0};
+        std::atomic<std::uint64_t>  blocks_allocated{0};
+        std::atomic<std::uint64_t>  lock_contention{0};
+        std::atomic<size_t>         free_slots{0};
+        std::atomic<size_t>         free_slots_high_water{0};
+        std::atomic<std::uint64_t>  requests{0};
+        std::atomic<std::uint64_t>  bytes_requested{0};
+    };
+    alignas(CACHE_LINE_SIZE)
+    Counters        stats_;                 // 统计计数器，全部使用 relaxed 原子操作
+#endif
+
 };
 
 
-class HashBucket
+/**
+ * @class ThreadCache
+ * @brief Per-thread front-end that caches free slots for every size class
+ *
+ * Each thread owns one small intrusive free list per MemoryPool managed by
+ * HashBucket. Allocations and deallocations hit the local list without any
+ * locking; the shared pool is only touched in batches, when a list runs
+ * empty (refill) or grows past its limit (flush).
+ *
+ * With ZP_ENABLE_NUMA, refills come from the pools of the node the thread
+ * is running on, and a slot owned by another node's pool is handed straight
+ * back to that pool instead of being cached.
+ *
+ * With ZP_POOL_SHARDS > 1, every thread is assigned one shard of the pools
+ * and refills from it, so threads of different shards never contend for
+ * the same pool locks. A refill that finds its shard without free slots or
+ * uncarved space first steals free slots of a sibling shard, and only
+ * grows its own shard if none has any. Flushes return every slot to the
+ * pool that owns its block.
+ *
+ * With ZP_ENABLE_REMOTE_FREE, every thread also owns a ThreadHeap holding
+ * one lock-free MPSC queue per size class. A refill stamps the blocks it
+ * took slots from with the thread's heap, unless the block already belongs
+ * to another live heap; a slot freed by another thread
+ * is pushed onto that heap's queue (one CAS, no lock) instead of growing
+ * the freeing thread's cache, and the owner takes the whole queue in one
+ * exchange on its next refill. In a producer/consumer pipeline the slots
+ * thus go back to the producer without touching the shared pool. An
+ * exiting thread closes its queues before giving up the heap, so no slot
+ * is pushed after its final drain.
+ * Batch frees (deallocateBatch()) keep their single-lock path.
+ *
+ * @note The cache of a thread is flushed back to the shared pools when the
+ *       thread exits. Frees and allocations made later during that thread's
+ *       exit (by other thread_local destructors) go straight to the pools.
+ */
+class ThreadCache
 {
 public:
-    static void initMemoryPool();
-    static MemoryPool& getMemoryPool(int index);
+    /**
+     * @brief Get the cache of the calling thread
+     * @return Reference to the thread-local cache instance
+     */
+    static ThreadCache& local(){
+        thread_local ThreadCache cache;
+        return cache;
+    }
 
-    static void* useMemory(size_t size){
-        if(size <=  0){
-            return nullptr;
-        }
-        if(size > MAX_SLOT_SIZE)
-            return operator new(size);
+    ThreadCache();
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    /**
+     * @brief Return every cached slot to its shared pool
+     */
+    ~ThreadCache();
 
-        // equal size/8 向上去整（因为分配内存只能大不能小）
-        return getMemoryPool(((size + 7) / SLOT_BASE_SIZE) - 1).Allocate();
+    /**
+     * @brief Allocate a slot of the given size class
+     * @param index Pool index as used by HashBucket::getMemoryPool()
+     * @param requested Bytes the caller asked for, for FragmentationStats (0: the whole slot)
+     * @return Pointer to a free slot
+     */
+    void* allocate(size_t index, size_t requested = 0){
+        FreeList& list = lists_[index];
+        if(list.head == nullptr){
+            refill(index);
+        }
+        Slot* slot = list.head;
+        list.head = slot->getNext();
+        --list.length;
+#if ZP_ENABLE_STATS
+        ++list.requests;
+        list.bytes_requested += requested != 0 ? requested : SizeClass::size(index);
+#else
+        (void)requested;
+#endif
+        Hardening::onAllocate(slot, SizeClass::size(index));
+        return slot;
     }
 
-    static void freeMemory(void* ptr, size_t size){
-        if(!ptr){
+    /**
+     * @brief Put a slot of the given size class back into the local cache
+     * @param ptr Slot previously returned by allocate() for the same index
+     * @param index Pool index as used by HashBucket::getMemoryPool()
+     */
+    void deallocate(void* ptr, size_t index){
+        if constexpr (Hardening::kEnabled){
+            MemoryPool::CheckSlot(ptr, nullptr, SizeClass::size(index));
+        }
+        Hardening::onFree(ptr, SizeClass::size(index));
+#if ZP_ENABLE_REMOTE_FREE
+        if(deallocateRemote(ptr, index)){
             return;
         }
-        if(size > MAX_SLOT_SIZE)
-        {
-            operator delete(ptr);
+#elif ZP_ENABLE_NUMA
+        if(numa_ && deallocateRemote(ptr, index)){
             return;
         }
-
-        getMemoryPool(((size + 7) / SLOT_BASE_SIZE) - 1).Deallocate(ptr);
+#endif
+        FreeList& list = lists_[index];
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        slot->setNext(list.head);
+        list.head = slot;
+        if(++list.length > 2 * batchSize(index)){
+            flush(index, batchSize(index));
+        }
     }
 
-    template<typename T, typename... Args>
-    friend T* newElement(Args&&... args);
+    /**
+     * @brief Allocate n slots of one size class
+     * @param index Pool index
+     * @param out Array that receives n slot pointers
+     * @param n Number of slots wanted
+     *
+     * Serves what it can from the local list and fetches the rest from the
+     * shared pool in one FetchChain() call.
+     */
+    void allocateBatch(size_t index, void** out, size_t n, size_t requested = 0);
 
-    template<typename T>
-    friend void deleteElement(T* p);
+    /**
+     * @brief Free n slots of one size class
+     * @param index Pool index
+     * @param ptrs Slots to free (nullptr entries are skipped)
+     * @param n Number of entries in ptrs
+     *
+     * The slots stay in the local list if it has room for all of them,
+     * otherwise the whole chain goes straight to the shared pool.
+     */
+    void deallocateBatch(size_t index, void** ptrs, size_t n);
 
-};
+    /**
+     * @brief Return every cached slot of this thread to the shared pools
+     *
+     * Slots queued for this thread by other threads' frees are returned too.
+     */
+    void flushAll();
 
+    /**
+     * @brief Hand this thread's request counters to the pools (ZP_ENABLE_STATS)
+     *
+     * Also done on every refill and flush of a size class.
+     */
+    void publishRequests();
 
-template<typename T, typename... Args>
-T* newElement(Args&&... args){
-    T* p = nullptr;
-    // 根据元素大小选取合适的内存池分配内存
-    if((p = reinterpret_cast<T*>(HashBucket::useMemory(sizeof(T)))) != nullptr){
-        // 在分配的内存上构造对象
-        new(p) T(std::forward<Args>(args)...);
+    /**
+     * @brief Number of slots moved between the cache and the pool at once
+     * @param index Pool index
+     * @return Batch size for that size class (smaller for larger slots)
+     */
+    static constexpr size_t batchSize(size_t index){
+        size_t slots = kBatchBytes / SizeClass::size(index);
+        return slots < kMinBatch ? kMinBatch : (slots > kMaxBatch ? kMaxBatch : slots);
     }
-    return p;
-}
 
-template<typename T>
-void deleteElement(T* p)
-{
+private:
+    struct FreeList{
+        Slot*   head = nullptr;     // 本线程缓存的空闲槽
+        size_t  length = 0;         // 链表长度
+#if ZP_ENABLE_STATS
+        std::uint64_t requests = 0;         // 尚未计入内存池的分配次数
+        std::uint64_t bytes_requested = 0;  // 这些分配请求的字节数
+#endif
+    };
+
+    /// @brief Bytes worth of slots fetched from the pool per refill
+    static constexpr size_t kBatchBytes = 4096;
+    static constexpr size_t kMinBatch = 2;
+    static constexpr size_t kMaxBatch = 128;
+    /// @brief List length marking a cache whose destructor already ran
+    static constexpr size_t kTornDown = SIZE_MAX / 2;
+
+    /**
+     * @brief Fetch one batch of slots from the shared pool
+     * @param index Pool index of the empty list
+     */
+    void refill(size_t index);
+
+    /**
+     * @brief Return count slots from the head of a local list to the shared pool
+     * @param index Pool index
+     * @param count Number of slots to hand back
+     */
+    void flush(size_t index, size_t count);
+
+    /**
+     * @brief Add the request counters of one list to its pool and reset them
+     * @param index Pool index
+     */
+    void publishRequests(size_t index);
+
+    /**
+     * @brief Give a chain back to the pools owning its slots
+     * @param head First slot of the chain
+     * @param tail Last slot of the chain
+     * @param index Pool index
+     *
+     * Slots can come from several pools of the class (other NUMA nodes,
+     * stolen from other shards); each run goes back to its owner so Trim()
+     * finds them on the right free list.
+     */
+    void release(Slot* head, Slot* tail, size_t index);
+
+    /**
+     * @brief Pool of a size class this thread refills from
+     * @param index Pool index
+     */
+    MemoryPool& pool(size_t index) const;
+
+    FreeList lists_[MEMORY_POOL_NUM];
+    int      node_ = 0;                     // 最近一次 refill 时所在的 NUMA 节点
+    int      shard_ = 0;                    // 本线程使用的分片
+
+#if ZP_ENABLE_NUMA || ZP_ENABLE_REMOTE_FREE
+    /**
+     * @brief Send a slot that does not belong in this cache back where it belongs
+     * @param ptr Slot being freed
+     * @param index Pool index
+     * @return true if the slot was remote and has been returned
+     *
+     * Slots of another node's pool go straight back to that pool; slots of a
+     * block stamped by another live thread heap go onto that heap's queue,
+     * unless that heap has already closed it on exit.
+     */
+    bool deallocateRemote(void* ptr, size_t index);
+#endif
+
+#if ZP_ENABLE_NUMA
+    bool     numa_ = false;                 // 是否存在多个 NUMA 节点
+#endif
+
+#if ZP_ENABLE_REMOTE_FREE
+    /**
+     * @brief Move the slots other threads queued for one size class into the local list
+     * @param index Pool index
+     * @return true if at least one slot was taken
+     */
+    bool drainRemote(size_t index);
+
+    /**
+     * @brief Move a chain taken from a remote queue into the local list
+     * @param index Pool index
+     * @param chain Null-terminated chain (nullptr: nothing to take)
+     * @return true if at least one slot was taken
+     */
+    bool takeRemote(size_t index, Slot* chain);
+
+    /**
+     * @brief Stamp the blocks of a freshly fetched chain with this thread's heap
+     * @param chain Null-terminated chain returned by MemoryPool::FetchChain()
+     *
+     * Blocks that already belong to another live heap keep their owner.
+     */
+    void claimBlocks(Slot* chain);
+
+    ThreadHeap* heap_ = nullptr;            // 本线程的跨线程释放队列，析构后为 nullptr
+#endif
+};
+
+
+#if ZP_PER_CPU_CACHE
+/**
+ * @class CpuCache
+ * @brief Per-CPU front-end replacing ThreadCache for HashBucket (ZP_PER_CPU_CACHE)
+ *
+ * Every CPU owns one set of free lists, one per size class, filled from and
+ * flushed to the MemoryPools in batches exactly like a thread cache. The
+ * memory cached in front of the pools thus scales with the number of cores
+ * rather than with the number of threads, which matters for processes
+ * with thousands of mostly idle threads; a thread never owns any cache.
+ *
+ * The CPU number comes from the rseq area glibc registers for every
+ * thread, so looking it up is a single load. A thread can still be
+ * preempted or migrated while it works on a CPU's lists, so each set is
+ * guarded by a flag taken with one exchange; a thread finding it held
+ * does not wait but goes straight to the pool (TCMalloc instead restarts
+ * the operation through rseq critical sections written in assembly).
+ *
+ * Where rseq is not registered (old kernels, glibc < 2.35, or the
+ * glibc.pthread.rseq tunable set to 0) currentCpu() returns -1 and
+ * HashBucket uses ThreadCache as without this option.
+ *
+ * Slots freed on a CPU are cached there whichever thread allocated them,
+ * so ZP_ENABLE_REMOTE_FREE does not apply to this front-end. With several
+ * pool sets (NUMA nodes, ZP_POOL_SHARDS) a CPU refills from its node's
+ * pools, in shard cpu % ZP_POOL_SHARDS, and flushes return every slot to
+ * the pool owning its block.
+ */
+class CpuCache
+{
+public:
+    /// @brief CPUs with their own cache; higher-numbered CPUs share them modulo this
+    static constexpr int kMaxCpus = 256;
+
+    /**
+     * @brief CPU the calling thread is running on
+     * @return CPU number, or -1 if rseq is not available to this thread
+     */
+    static int currentCpu(){
+#if ZP_HAVE_RSEQ
+        if(__rseq_size == 0){
+            return -1;
+        }
+        const struct rseq* area = reinterpret_cast<const struct rseq*>(
+            static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+        // 内核在每次调度时写 cpu_id；未注册时为负数
+        return static_cast<int>(__atomic_load_n(&area->cpu_id, __ATOMIC_RELAXED));
+#else
+        return -1;
+#endif
+    }
+
+    /**
+     * @brief Allocate a slot of the given size class from a CPU's cache
+     * @param cpu Result of currentCpu(), not negative
+     * @param index Pool index as used by HashBucket::getMemoryPool()
+     * @param requested Bytes the caller asked for, for FragmentationStats (0: the whole slot)
+     * @return Pointer to a free slot
+     */
+    static void* allocate(int cpu, size_t index, size_t requested = 0){
+        Slab& slab = slabs_[cpu % kMaxCpus];
+        if(slab.busy.exchange(true, std::memory_order_acquire)) [[unlikely]] {
+            return allocateUncached(index, requested);
+        }
+        FreeList& list = slab.lists[index];
+        if(list.head == nullptr){
+            refill(slab, cpu, index);
+        }
+        Slot* slot = list.head;
+        list.head = slot->getNext();
+        --list.length;
+#if ZP_ENABLE_STATS
+        ++list.requests;
+        list.bytes_requested += requested != 0 ? requested : SizeClass::size(index);
+#else
+        (void)requested;
+#endif
+        slab.busy.store(false, std::memory_order_release);
+        Hardening::onAllocate(slot, SizeClass::size(index));
+        return slot;
+    }
+
+    /**
+     * @brief Put a slot of the given size class into a CPU's cache
+     * @param cpu Result of currentCpu(), not negative
+     * @param ptr Slot of a HashBucket pool of that size class
+     * @param index Pool index as used by HashBucket::getMemoryPool()
+     */
+    static void deallocate(int cpu, void* ptr, size_t index){
+        if constexpr (Hardening::kEnabled){
+            MemoryPool::CheckSlot(ptr, nullptr, SizeClass::size(index));
+        }
+        Hardening::onFree(ptr, SizeClass::size(index));
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        Slab& slab = slabs_[cpu % kMaxCpus];
+        if(slab.busy.exchange(true, std::memory_order_acquire)) [[unlikely]] {
+            MemoryPool::ReleaseToOwners(slot, slot);
+            return;
+        }
+        FreeList& list = slab.lists[index];
+        slot->setNext(list.head);
+        list.head = slot;
+        if(++list.length > 2 * ThreadCache::batchSize(index)){
+            flush(slab, index, ThreadCache::batchSize(index));
+        }
+        slab.busy.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Allocate n slots of one size class, taking the CPU's cache once
+     * @param cpu Result of currentCpu(), not negative
+     * @param index Pool index
+     * @param out Array that receives n slot pointers
+     * @param n Number of slots wanted
+     * @param requested Bytes asked for per slot (0: the whole slot)
+     */
+    static void allocateBatch(int cpu, size_t index, void** out, size_t n, size_t requested = 0);
+
+    /**
+     * @brief Free n slots of one size class, taking the CPU's cache once
+     * @param cpu Result of currentCpu(), not negative
+     * @param index Pool index
+     * @param ptrs Slots to free (nullptr entries are skipped)
+     * @param n Number of entries in ptrs
+     */
+    static void deallocateBatch(int cpu, size_t index, void** ptrs, size_t n);
+
+    /**
+     * @brief Return the slots cached by every CPU to the pools
+     *
+     * Waits for each CPU's cache to be free in turn.
+     */
+    static void flushAll();
+
+    /**
+     * @brief Hand every CPU's request counters to the pools (ZP_ENABLE_STATS)
+     */
+    static void publishRequests();
+
+    /**
+     * @brief Slots currently cached by one CPU, over all size classes
+     * @param cpu CPU number
+     */
+    static size_t cachedSlots(int cpu);
+
+private:
+    struct FreeList{
+        Slot*   head = nullptr;     // 本 CPU 缓存的空闲槽
+        size_t  length = 0;         // 链表长度
+#if ZP_ENABLE_STATS
+        std::uint64_t requests = 0;         // 尚未计入内存池的分配次数
+        std::uint64_t bytes_requested = 0;  // 这些分配请求的字节数
+#endif
+    };
+
+    // 每个 CPU 一份，独占 cache line：不同 CPU 上的线程互不干扰
+    struct alignas(CACHE_LINE_SIZE) Slab{
+        std::atomic<bool>   busy{false};    // 有线程正在操作这些链表
+        int                 node = 0;       // 所在 NUMA 节点，refill 时确定
+        FreeList            lists[MEMORY_POOL_NUM];
+    };
+
+    /**
+     * @brief Fill an empty list of a locked slab with one batch from the pool
+     */
+    static void refill(Slab& slab, int cpu, size_t index);
+
+    /**
+     * @brief Return count slots from the head of a list of a locked slab to the pools
+     */
+    static void flush(Slab& slab, size_t index, size_t count);
+
+    /**
+     * @brief Add the request counters of one list of a locked slab to its pool and reset them
+     */
+    static void publishRequests(Slab& slab, int cpu, size_t index);
+
+    /**
+     * @brief Take one slot straight from the pool while the CPU's cache is held by another thread
+     */
+    static void* allocateUncached(size_t index, size_t requested);
+
+    /**
+     * @brief Pool a CPU refills from
+     */
+    static MemoryPool& pool(const Slab& slab, int cpu, size_t index);
+
+    /**
+     * @brief Take a slab, waiting for the thread that holds it
+     */
+    static void lock(Slab& slab);
+
+    static Slab slabs_[kMaxCpus];
+};
+#endif
+
+class HashBucket
+{
+public:
+    /**
+     * @brief Smallest size mapped directly with mmap instead of coming from operator new
+     *
+     * Such allocations are registered in the PageMap like pool blocks, so
+     * freeMemory(void*) recognizes them and reallocMemory() can resize
+     * them with mremap without copying. Sizes between MAX_SLOT_SIZE and
+     * this threshold stay with operator new (glibc serves those from its
+     * heap and maps only above 128 KiB too).
+     */
+    static constexpr size_t kMapThreshold = 128 * 1024;
+
+    /**
+     * @brief Default block growth for a size class
+     * @param slot_size Slot size of the class in bytes
+     * @return 4 KiB first block doubling up to 64 KiB, scaled up for large
+     *         classes so a block holds at least 4 slots at first and 16 at the cap
+     */
+    static constexpr BlockSizePolicy defaultBlockSizePolicy(size_t slot_size){
+        BlockSizePolicy policy;
+        while(policy.initial_size < 4 * slot_size){
+            policy.initial_size *= 2;
+        }
+        while(policy.max_size < 16 * slot_size){
+            policy.max_size *= 2;
+        }
+        return policy;
+    }
+
+    /**
+     * @brief Configure every size-class pool
+     * @param policy Free list synchronization used by all pools (default: Locked)
+     * @param block_policy Maps a slot size to the block growth policy of its pool
+     *
+     * Optional: the pools are constant-initialized with their slot sizes
+     * and the default policies, so useMemory() works without it. Calling
+     * it again later never discards memory the pools already hold.
+     */
+    static void initMemoryPool(FreeListPolicy policy = FreeListPolicy::Locked,
+                               BlockSizePolicy (*block_policy)(size_t slot_size) = defaultBlockSizePolicy);
+
+    /**
+     * @brief Pool of a size class on the calling thread's NUMA node and shard
+     * @param index Size class index in [0, MEMORY_POOL_NUM)
+     * @return The pool
+     * @throw std::out_of_range if index is out of range
+     */
+    static MemoryPool& getMemoryPool(int index);
+
+    /**
+     * @brief Pool of a size class on a given NUMA node, in the calling thread's shard
+     * @param index Size class index in [0, MEMORY_POOL_NUM)
+     * @param node Node in [0, numaNodes())
+     * @return The pool
+     * @throw std::out_of_range if index or node is out of range
+     */
+    static MemoryPool& getMemoryPool(int index, int node);
+
+    /**
+     * @brief Number of per-node pool sets in use
+     * @return 1 unless built with ZP_ENABLE_NUMA on a machine with several nodes
+     *
+     * Each set takes its blocks from a NumaBlockProvider bound to its node,
+     * so memory is allocated node-locally.
+     */
+    static int numaNodes();
+
+    /**
+     * @brief Pool set the calling thread allocates from
+     * @return NUMA node of the CPU the thread is running on, in [0, numaNodes())
+     */
+    static int currentNumaNode();
+
+    /**
+     * @brief Pool of a size class in one shard of a NUMA node
+     * @param index Size class index in [0, MEMORY_POOL_NUM)
+     * @param node Node in [0, numaNodes())
+     * @param shard Shard in [0, poolShards())
+     * @return The pool
+     * @throw std::out_of_range if index, node or shard is out of range
+     */
+    static MemoryPool& getMemoryPool(int index, int node, int shard);
+
+    /**
+     * @brief Number of pools per size class on each NUMA node (ZP_POOL_SHARDS)
+     */
+    static constexpr int poolShards(){ return ZP_POOL_SHARDS; }
+
+    /**
+     * @brief Shard the calling thread allocates from
+     * @return Shard in [0, poolShards()), assigned round-robin to each thread on first use
+     *
+     * getMemoryPool(index) and getMemoryPool(index, node) return the pools
+     * of this shard.
+     */
+    static int currentShard();
+
+    static void* useMemory(size_t size){
+        if(size <=  0){
+            return nullptr;
+        }
+        if(size > MAX_SLOT_SIZE)
+            return sampled(allocateLarge(size), size, MEMORY_POOL_NUM);
+
+        const size_t index = SizeClass::index(size);
+        return sampled(cachedAllocate(index, size), size, index);
+    }
+
+    /**
+     * @brief Allocate one slot of a size class known in advance
+     * @param index Size class index in [0, MEMORY_POOL_NUM); not checked
+     * @param size Requested size in [1, SizeClass::size(index)], for statistics and sampling
+     * @return The slot
+     *
+     * useMemory(size) without the size-to-class computation, for callers
+     * that fix the class at compile time such as PoolAllocator. Goes
+     * through the same per-CPU or per-thread cache and heap sampling.
+     * Free with freeClass(ptr, index) or any freeMemory() overload.
+     */
+    static void* useClass(size_t index, size_t size){
+        return sampled(cachedAllocate(index, size), size, index);
+    }
+
+    /**
+     * @brief Free a slot obtained for a size class
+     * @param ptr Slot from useClass(index, size) or useMemory() (nullptr is ignored)
+     * @param index The slot's size class; not checked
+     */
+    static void freeClass(void* ptr, size_t index){
+        if(!ptr){
+            return;
+        }
+        if(HeapProfiler::active()) [[unlikely]] {
+            HeapProfiler::onFree(ptr);
+        }
+        cachedDeallocate(ptr, index);
+    }
+
+    /**
+     * @brief Allocate memory with an explicit alignment
+     * @param size Requested size in bytes
+     * @param align Required alignment, a power of two
+     * @return Pointer aligned to align, or nullptr when size is 0
+     *
+     * Served by the smallest size class whose slots are aligned to align
+     * (see SizeClass::index(size, align)); requests no class can satisfy,
+     * such as alignments above 4 KiB, go to the aligned operator new, or
+     * are mapped like useMemory(size) from kMapThreshold on when align is
+     * at most CACHE_LINE_SIZE. Free with freeMemory(ptr, size, align).
+     */
+    static void* useMemory(size_t size, size_t align){
+        if(size == 0){
+            return nullptr;
+        }
+        const size_t index = SizeClass::index(size, align);
+        if(index >= MEMORY_POOL_NUM){
+            if(size >= kMapThreshold && align <= CACHE_LINE_SIZE){
+                return sampled(allocateLarge(size), size, MEMORY_POOL_NUM);
+            }
+            return sampled(operator new(size, std::align_val_t(align)), size, MEMORY_POOL_NUM);
+        }
+        return sampled(cachedAllocate(index, size), size, index);
+    }
+
+    /**
+     * @brief Free memory obtained from useMemory(size, align)
+     * @param ptr Pointer to free (nullptr is ignored)
+     * @param size The size passed to useMemory()
+     * @param align The alignment passed to useMemory()
+     */
+    static void freeMemory(void* ptr, size_t size, size_t align){
+        if(!ptr){
+            return;
+        }
+        if(HeapProfiler::active()) [[unlikely]] {
+            HeapProfiler::onFree(ptr);
+        }
+        const size_t index = SizeClass::index(size, align);
+        if(index >= MEMORY_POOL_NUM){
+            if(size >= kMapThreshold && align <= CACHE_LINE_SIZE){
+                freeLarge(ptr, size);
+                return;
+            }
+            operator delete(ptr, std::align_val_t(align));
+            return;
+        }
+        cachedDeallocate(ptr, index);
+    }
+
+    static void freeMemory(void* ptr, size_t size){
+        if(!ptr){
+            return;
+        }
+        if(HeapProfiler::active()) [[unlikely]] {
+            HeapProfiler::onFree(ptr);
+        }
+        if(size > MAX_SLOT_SIZE)
+        {
+            freeLarge(ptr, size);
+            return;
+        }
+
+        cachedDeallocate(ptr, SizeClass::index(size));
+    }
+
+    /**
+     * @brief Resize memory obtained from useMemory(size), like realloc()
+     * @param ptr Pointer from useMemory(old_size) (nullptr behaves like useMemory(new_size))
+     * @param old_size The size ptr was allocated or last resized with
+     * @param new_size Requested size (0 frees ptr and returns nullptr)
+     * @return Pointer to new_size bytes holding the first min(old_size, new_size) bytes of ptr
+     *
+     * Returns ptr itself when new_size falls into the same size class, and
+     * resizes allocations of at least kMapThreshold in place or through
+     * mremap. Everything else moves to a new allocation with one copy.
+     * Afterwards free with freeMemory(result, new_size).
+     * @throw std::bad_alloc if the new memory cannot be obtained; ptr is then left unchanged
+     */
+    static void* reallocMemory(void* ptr, size_t old_size, size_t new_size);
+
+    /**
+     * @brief Free memory without knowing its size
+     * @param ptr Pointer from useMemory(), or a slot of any MemoryPool (nullptr is ignored)
+     *
+     * The owning block is found through the PageMap, so no per-object header
+     * is needed. HashBucket slots go through the thread cache like
+     * freeMemory(ptr, size); slots of a standalone MemoryPool are returned
+     * to that pool; allocations mapped from kMapThreshold on are unmapped;
+     * anything else is a large allocation and goes to operator delete.
+     *
+     * @note Memory from useMemory(size, align) that fell back to the aligned
+     *       operator new must be freed with freeMemory(ptr, size, align).
+     */
+    static void freeMemory(void* ptr);
+
+    /**
+     * @brief Free ptr if it lies in a pool block
+     * @param ptr Non-null pointer
+     * @return false, without touching ptr, if it is not pool memory
+     *
+     * The building block of freeMemory(void*) for callers that have their
+     * own fallback, such as the global operator delete replacement.
+     */
+    static bool tryFreeMemory(void* ptr);
+
+    /**
+     * @brief Allocate n blocks of the same size
+     * @param size Requested size of each block in bytes
+     * @param out Array that receives n pointers
+     * @param n Number of blocks to allocate
+     *
+     * For pooled sizes the shared pool is locked at most once per call.
+     * A size of 0 fills out with nullptr, like useMemory(0).
+     */
+    static void useMemoryBatch(size_t size, void** out, size_t n);
+
+    /**
+     * @brief Free n blocks that were all allocated with the same size
+     * @param ptrs Pointers to free (nullptr entries are skipped)
+     * @param size Size that was passed to useMemory()/useMemoryBatch()
+     * @param n Number of entries in ptrs
+     */
+    static void freeMemoryBatch(void** ptrs, size_t size, size_t n);
+
+    /**
+     * @brief Snapshot the statistics of every size-class pool
+     * @return One PoolStats per pool, indexed like getMemoryPool(), summed over all NUMA nodes
+     */
+    static std::array<PoolStats, MEMORY_POOL_NUM> snapshotStats();
+
+    /**
+     * @brief Print snapshotStats() as a table, one line per non-empty pool
+     * @param os Output stream
+     */
+    static void dumpStats(std::ostream& os);
+
+    /**
+     * @brief Walk the blocks of every size-class pool
+     * @return One FragmentationStats per pool, indexed like getMemoryPool(), summed over all NUMA nodes
+     *
+     * Publishes the calling thread's request counters first; other threads'
+     * counts reach the pools on their next refill or flush.
+     */
+    static std::array<FragmentationStats, MEMORY_POOL_NUM> fragmentationReport();
+
+    /**
+     * @brief Print fragmentationReport() as a table, one line per non-empty pool plus a total
+     * @param os Output stream
+     */
+    static void dumpFragmentation(std::ostream& os);
+
+    /**
+     * @brief Read back a table written by dumpStats()
+     * @param is Input stream positioned at the header line
+     * @return One PoolStats per pool; classes missing from the table are zero
+     *
+     * Lets a profile recorded by one run warm up the next one (see warmup()).
+     */
+    static std::array<PoolStats, MEMORY_POOL_NUM> parseStats(std::istream& is);
+
+    /**
+     * @brief Pre-allocate and prefault the pools from a recorded profile
+     * @param profile Statistics, e.g. snapshotStats() at steady state or parseStats() of a dump
+     * @return Number of slots added over all pools
+     *
+     * Every pool of the calling thread's NUMA node and shard is grown with
+     * MemoryPool::Reserve() to the number of slots it had carved in the
+     * profile (live plus free). Profiles from a build without
+     * ZP_ENABLE_STATS only have bytes_reserved; bytes_reserved / slot_size
+     * ignores block headers and may reserve up to one extra block.
+     */
+    static size_t warmup(const std::array<PoolStats, MEMORY_POOL_NUM>& profile);
+
+    /**
+     * @brief Pre-allocate and prefault the pools to explicit capacities
+     * @param slots Wanted capacity in slots per pool, indexed like getMemoryPool()
+     * @return Number of slots added over all pools
+     */
+    static size_t warmup(const std::array<size_t, MEMORY_POOL_NUM>& slots);
+
+    /**
+     * @brief Release idle blocks of every pool
+     * @return Number of bytes given back to the system
+     *
+     * Flushes the calling thread's cache first so its slots can count as
+     * free; other threads' caches are left alone.
+     */
+    static size_t trimAll();
+
+    /**
+     * @brief Run trimAll() periodically on a background thread
+     * @param interval Time between two trims
+     *
+     * Calling it again changes the interval of the running trimmer.
+     */
+    static void startBackgroundTrim(std::chrono::milliseconds interval);
+
+    /**
+     * @brief Stop the background trimmer started by startBackgroundTrim()
+     */
+    static void stopBackgroundTrim();
+
+    /**
+     * @brief Take new blocks of every pool from the given provider
+     * @param provider Upstream provider, e.g. &HugePageBlockProvider::instance(),
+     *        or nullptr to go back to the built-in one; it must live until
+     *        the process exits
+     *
+     * Applies to the pools of every NUMA node. The built-in provider of a
+     * node's pools is its NumaBlockProvider when ZP_ENABLE_NUMA is on.
+     */
+    static void setBlockProvider(BlockProvider* provider);
+
+    /**
+     * @brief Choose whether the pools give their idle blocks back at process exit
+     * @param release true to trim every pool during static destruction,
+     *        false to leave all memory to the operating system
+     *
+     * Teardown model: a thread's cache is flushed to the shared pools when
+     * the thread exits (the main thread's before any static destructor
+     * runs). The pools themselves are never destroyed, so memory freed or
+     * allocated by later static destructors, or by threads still running
+     * while the process exits, keeps going through valid pools.
+     *
+     * With release, the pools' static destructor flushes the per-CPU caches
+     * (ZP_PER_CPU_CACHE) and gives back every block without live slots, as
+     * trimAll() does, which keeps leak checkers quiet about idle pool memory.
+     * Blocks still referenced by the program or by the cache of a running
+     * thread stay mapped. Without release, the exit path does nothing at
+     * all, so shutdown does not walk the blocks of large heaps.
+     *
+     * The default is ZP_RELEASE_AT_EXIT (on). The global operator new
+     * replacement switches it off.
+     */
+    static void setReleaseAtExit(bool release);
+
+    /**
+     * @brief Whether the pools give their idle blocks back at process exit
+     * @return The value last set with setReleaseAtExit()
+     */
+    static bool releaseAtExit();
+
+    template<typename T, typename... Args>
+    friend T* newElement(Args&&... args);
+
+    template<typename T>
+    friend void deleteElement(T* p);
+
+    template<typename Config>
+    friend class BasicHashBucket;
+
+private:
+    // 前端：能读到 CPU 号时用 CPU 缓存，否则用线程缓存
+    static void* cachedAllocate(size_t index, size_t requested){
+#if ZP_PER_CPU_CACHE
+        if(const int cpu = CpuCache::currentCpu(); cpu >= 0){
+            return CpuCache::allocate(cpu, index, requested);
+        }
+#endif
+        return ThreadCache::local().allocate(index, requested);
+    }
+    static void cachedDeallocate(void* ptr, size_t index){
+#if ZP_PER_CPU_CACHE
+        if(const int cpu = CpuCache::currentCpu(); cpu >= 0){
+            CpuCache::deallocate(cpu, ptr, index);
+            return;
+        }
+#endif
+        ThreadCache::local().deallocate(ptr, index);
+    }
+
+    // 大于 MAX_SLOT_SIZE 的分配：kMapThreshold 以下走 operator new，以上直接 mmap
+    static void* allocateLarge(size_t size);
+    static void freeLarge(void* ptr, size_t size);
+
+    // 采样关闭时只多一次 relaxed load 和一个可预测的分支
+    static void* sampled(void* ptr, size_t size, size_t index){
+        if(HeapProfiler::active()) [[unlikely]] {
+            HeapProfiler::onAllocate(ptr, size, index);
+        }
+        return ptr;
+    }
+};
+
+/**
+ * @struct DefaultPoolConfig
+ * @brief Configuration of BasicHashBucket matching HashBucket's pools
+ *
+ * Besides the size-class parameters of DefaultSizeClasses a configuration
+ * names the free list synchronization and the block growth of its pools:
+ * @code
+ * struct SmallMessages : ZPmemoryPool::DefaultPoolConfig{
+ *     static constexpr size_t kSpacing = 16;
+ *     static constexpr size_t kMaxSize = 1024;
+ *     static constexpr ZPmemoryPool::FreeListPolicy kFreeListPolicy = ZPmemoryPool::FreeListPolicy::LockFree;
+ * };
+ * using MessageHeap = ZPmemoryPool::BasicHashBucket<SmallMessages>;
+ * @endcode
+ */
+struct DefaultPoolConfig : DefaultSizeClasses{
+    /// @brief Free list synchronization of every pool
+    static constexpr FreeListPolicy kFreeListPolicy = FreeListPolicy::Locked;
+
+    /**
+     * @brief Block growth of a size class
+     * @param slot_size Slot size of the class in bytes
+     */
+    static constexpr BlockSizePolicy blockSizePolicy(size_t slot_size){
+        return HashBucket::defaultBlockSizePolicy(slot_size);
+    }
+};
+
+/**
+ * @class BasicHashBucket
+ * @brief A family of size-class pools whose parameters are fixed at compile time
+ * @tparam Config Size classes, free list policy and block policy, see DefaultPoolConfig
+ *
+ * Every instantiation owns its own constant-initialized pools, so separate
+ * subsystems of one binary can use independently tuned pool families that
+ * never share blocks with HashBucket or with each other. The class count,
+ * spacing and maximum size are template constants: the size-to-class math
+ * of useMemory() folds to a constant for constant sizes, and there is no
+ * runtime index check or throw on the allocation path.
+ *
+ * A family has no thread or CPU caches and no NUMA or shard sets: each
+ * call goes straight to the pool of its class, which synchronizes as
+ * Config::kFreeListPolicy says. Sizes above kMaxSize are served like
+ * HashBucket's large allocations. Slots are registered in the PageMap, so
+ * freeMemory(void*) (and HashBucket::freeMemory(void*)) finds their pool.
+ *
+ * The pools are never destroyed; at process exit their idle blocks are
+ * given back when HashBucket::releaseAtExit() is set.
+ */
+template<typename Config = DefaultPoolConfig>
+class BasicHashBucket{
+public:
+    /// @brief Size-class table of this family
+    using Classes = BasicSizeClass<Config>;
+    /// @brief Number of size classes, one pool each
+    static constexpr size_t kNumClasses = Classes::kNumClasses;
+    /// @brief Largest size served from a pool
+    static constexpr size_t kMaxSize = Classes::kMaxSize;
+    /// @brief Free list synchronization of every pool
+    static constexpr FreeListPolicy kFreeListPolicy = Config::kFreeListPolicy;
+
+    /**
+     * @brief Pool of a size class, checked at compile time
+     * @tparam Index Size class index in [0, kNumClasses)
+     */
+    template<size_t Index>
+    static MemoryPool& pool(){
+        static_assert(Index < kNumClasses, "size class out of range");
+        return table_.pools[Index];
+    }
+
+    /**
+     * @brief Pool of a size class
+     * @param index Size class index in [0, kNumClasses); not checked
+     */
+    static MemoryPool& pool(size_t index){ return table_.pools[index]; }
+
+    static void* useMemory(size_t size){
+        if(size == 0){
+            return nullptr;
+        }
+        if(size > kMaxSize){
+            return HashBucket::allocateLarge(size);
+        }
+        return table_.pools[Classes::index(size)].Allocate();
+    }
+
+    /**
+     * @brief Allocate memory with an explicit alignment
+     * @param size Requested size in bytes
+     * @param align Required alignment, a power of two
+     * @return Pointer aligned to align, or nullptr when size is 0
+     *
+     * Same fallbacks as HashBucket::useMemory(size, align).
+     */
+    static void* useMemory(size_t size, size_t align){
+        if(size == 0){
+            return nullptr;
+        }
+        const size_t index = Classes::index(size, align);
+        if(index >= kNumClasses){
+            if(size >= HashBucket::kMapThreshold && align <= CACHE_LINE_SIZE){
+                return HashBucket::allocateLarge(size);
+            }
+            return operator new(size, std::align_val_t(align));
+        }
+        return table_.pools[index].Allocate();
+    }
+
+    static void freeMemory(void* ptr, size_t size){
+        if(!ptr){
+            return;
+        }
+        if(size > kMaxSize){
+            HashBucket::freeLarge(ptr, size);
+            return;
+        }
+        table_.pools[Classes::index(size)].Deallocate(ptr);
+    }
+
+    /**
+     * @brief Free memory obtained from useMemory(size, align)
+     * @param ptr Pointer to free (nullptr is ignored)
+     * @param size The size passed to useMemory()
+     * @param align The alignment passed to useMemory()
+     */
+    static void freeMemory(void* ptr, size_t size, size_t align){
+        if(!ptr){
+            return;
+        }
+        const size_t index = Classes::index(size, align);
+        if(index >= kNumClasses){
+            if(size >= HashBucket::kMapThreshold && align <= CACHE_LINE_SIZE){
+                HashBucket::freeLarge(ptr, size);
+                return;
+            }
+            operator delete(ptr, std::align_val_t(align));
+            return;
+        }
+        table_.pools[index].Deallocate(ptr);
+    }
+
+    /**
+     * @brief Free memory without knowing its size
+     * @param ptr Pointer from this family (nullptr is ignored); same rules as HashBucket::freeMemory(void*)
+     */
+    static void freeMemory(void* ptr){ HashBucket::freeMemory(ptr); }
+
+    /**
+     * @brief Allocate and construct an object
+     * @return The object, constructed with args
+     */
+    template<typename T, typename... Args>
+    static T* newElement(Args&&... args){
+        return new(useMemory(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Destroy and free an object from newElement()
+     * @param p Object (nullptr is ignored), possibly through a pointer to a polymorphic base
+     *
+     * Same rules as the global deleteElement(): polymorphic objects are
+     * freed by address, so the slot goes back to the derived class's pool.
+     */
+    template<typename T>
+    static void deleteElement(T* p){
+        if(!p){
+            return;
+        }
+        if constexpr (std::is_polymorphic_v<T>){
+            // 通过基类指针删除时 sizeof(T) 不是真实大小，按地址反查所属内存池
+            void* object = dynamic_cast<void*>(p);
+            p->~T();
+            if constexpr (alignof(T) > Classes::kMaxAlignment){
+                // 超过页对齐的类型来自带对齐的 operator new
+                if(!HashBucket::tryFreeMemory(object)){
+                    operator delete(object, std::align_val_t(alignof(T)));
+                }
+            }else{
+                freeMemory(object);
+            }
+        }else{
+            p->~T();
+            freeMemory(p, sizeof(T), alignof(T));
+        }
+    }
+
+    /**
+     * @brief Snapshot the statistics of every pool
+     * @return One PoolStats per size class
+     */
+    static std::array<PoolStats, kNumClasses> snapshotStats(){
+        std::array<PoolStats, kNumClasses> result;
+        for(size_t i = 0; i < kNumClasses; ++i){
+            result[i] = table_.pools[i].stats();
+        }
+        return result;
+    }
+
+    /**
+     * @brief Release idle blocks of every pool
+     * @return Number of bytes given back to the system
+     */
+    static size_t trim(){
+        size_t released = 0;
+        for(MemoryPool& p : table_.pools){
+            released += p.Trim();
+        }
+        return released;
+    }
+
+private:
+    // 常量初始化的内存池表；包一层 union，和 HashBucket 的内存池一样永不析构
+    template<size_t... I>
+    struct Table{
+        constexpr Table()
+        : pools{MemoryPool(Classes::size(I), Config::blockSizePolicy(Classes::size(I)), kFreeListPolicy)...} {}
+        ~Table(){
+            if(HashBucket::releaseAtExit()){
+                trim();
+            }
+        }
+        union { MemoryPool pools[sizeof...(I)]; };
+    };
+
+    template<size_t... I>
+    static Table<I...> makeTable(std::index_sequence<I...>);
+
+    using PoolTable = decltype(makeTable(std::make_index_sequence<kNumClasses>()));
+
+    static PoolTable table_;
+};
+
+template<typename Config>
+constinit typename BasicHashBucket<Config>::PoolTable BasicHashBucket<Config>::table_{};
+
+
+template<typename T, typename... Args>
+T* newElement(Args&&... args){
+    T* p = nullptr;
+    // 根据元素大小和对齐要求选取合适的内存池分配内存
+    if((p = reinterpret_cast<T*>(HashBucket::useMemory(sizeof(T), alignof(T)))) != nullptr){
+        // 在分配的内存上构造对象
+        new(p) T(std::forward<Args>(args)...);
+    }
+    return p;
+}
+
+template<typename T>
+void deleteElement(T* p)
+{
     // 对象析构
     if(p)
     {
-        p->~T();
-        // 内存回收
-        HashBucket::freeMemory(reinterpret_cast<void*>(p), sizeof(T));
+        if constexpr (std::is_polymorphic_v<T>){
+            // 通过基类指针删除时 sizeof(T) 不是真实大小，按地址反查所属内存池
+            void* object = dynamic_cast<void*>(p);
+            p->~T();
+            if constexpr (alignof(T) > SizeClass::kMaxAlignment){
+                // 超过页对齐的类型来自带对齐的 operator new，必须用同样的对齐释放
+                //（派生类的对齐比基类大时，要通过同样对齐的指针删除）
+                if(!HashBucket::tryFreeMemory(object)){
+                    if(HeapProfiler::active()){
+                        HeapProfiler::onFree(object);
+                    }
+                    operator delete(object, std::align_val_t(alignof(T)));
+                }
+            }else{
+                HashBucket::freeMemory(object);
+            }
+        }else{
+            p->~T();
+            // 内存回收
+            HashBucket::freeMemory(reinterpret_cast<void*>(p), sizeof(T), alignof(T));
+        }
     }
 }
 